@@ -0,0 +1,949 @@
+// batch.c
+// Non-interactive command / batch mode.
+//
+//   dir_manage list    DIR [--sort name|size|date] [--offset N] [--limit N]
+//   dir_manage search  DIR PATTERN
+//   dir_manage report  DIR [--txt FILE] [--csv FILE]
+//   dir_manage cleanup DIR [--min-size BYTES] [--min-age DAYS] [--delete]
+//   dir_manage copy    SRC DST
+//   dir_manage move    SRC DST
+//   dir_manage rm      [-r] PATH
+//   dir_manage pack    DIR PACKFILE [--max-size BYTES] [--min-age DAYS] [--delete]
+//   dir_manage packls  PACKFILE
+//   dir_manage unpack  PACKFILE [NAME] [--to DIR]
+//   dir_manage --batch FILE        (one command per line, '-' = stdin)
+//   dir_manage serve|query ...     (in-memory daemon, see daemon.c)
+//
+// Global options before the command: --metrics prints per-call-class
+// latency totals to stderr, --metrics-file FILE writes Prometheus text,
+// -L/-P follow or skip symlinks, --xdev stays on one filesystem, and
+// --io-uring [--queue-depth N] batches metadata and copy I/O, and
+// --max-ops N / --max-mbps N / --idle-io / --adaptive throttle cleanup,
+// rm and copy so they can run next to a production workload, and
+// --verify checks copy/move against a CRC32C read-back of the target.
+//
+// --jobs N caps the walker threads and --no-tune keeps the per-device
+// starting limits (see devices.c).
+//
+// Adjacent search/report/cleanup/pack commands on the same DIR share a
+// single traversal; a command with --delete ends the group. A pool of
+// walker threads stats the tree and hands entries to the consumer
+// through a bounded buffer guarded by two semaphores. Each directory read holds a walk slot on its device, so a
+// spinning disk is read by one thread while an NVMe drive gets many.
+#include "dir_manage.h"
+#include <errno.h>
+#include <ctype.h>
+
+#define MAX_BATCH_OPS   256
+#define MAX_OP_ARGS     16
+#define WALK_QUEUE_SIZE 256
+#define PACK_DEFAULT_MAX_SIZE 65536     // 'pack' targets small files by default
+
+typedef enum {
+    OP_LIST,
+    OP_SEARCH,
+    OP_REPORT,
+    OP_CLEANUP,
+    OP_COPY,
+    OP_MOVE,
+    OP_RM,
+    OP_PACK,
+    OP_PACKLS,
+    OP_UNPACK
+} OpType;
+
+// File to delete once the op is done, as the walk saw it
+typedef struct Victim {
+    char path[PATH_MAX];
+    struct stat st;
+} Victim;
+
+typedef struct BatchOp {
+    OpType type;
+    char root[PATH_MAX];        // DIR for list/search/report/cleanup, SRC/PATH otherwise
+    char arg[PATH_MAX];         // PATTERN for search, DST for copy/move, PACKFILE for pack
+    char txtFile[PATH_MAX];
+    char csvFile[PATH_MAX];
+    char destDir[PATH_MAX];     // unpack --to
+    int sortChoice;
+    size_t offset;
+    size_t limit;
+    long sizeLimit;
+    long maxSize;
+    int daysOld;
+    int doDelete;
+    int recursive;
+
+    // Per-run state (shared traversal)
+    long matches;
+    FileInfo *files;
+    int fileCount;
+    int fileCap;
+    Victim *victims;
+    int victimCount;
+    int victimCap;
+    Pack *pack;
+    long removed;
+    int packErrors;
+    int failed;
+} BatchOp;
+
+// ===============================================================
+// JSON OUTPUT
+// ===============================================================
+// Shared with daemon.c, which writes to a socket instead of stdout
+void writeJSONString(FILE *fp, const char *s) {
+    putc('"', fp);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        switch (c) {
+            case '"':  fputs("\\\"", fp); break;
+            case '\\': fputs("\\\\", fp); break;
+            case '\n': fputs("\\n", fp); break;
+            case '\t': fputs("\\t", fp); break;
+            default:
+                if (c < 0x20) fprintf(fp, "\\u%04x", c);
+                else putc(c, fp);
+        }
+    }
+    putc('"', fp);
+}
+
+static void printJSONString(const char *s) {
+    writeJSONString(stdout, s);
+}
+
+static const char *opName(OpType t) {
+    switch (t) {
+        case OP_LIST:    return "list";
+        case OP_SEARCH:  return "search";
+        case OP_REPORT:  return "report";
+        case OP_CLEANUP: return "cleanup";
+        case OP_COPY:    return "copy";
+        case OP_MOVE:    return "move";
+        case OP_RM:      return "rm";
+        case OP_PACK:    return "pack";
+        case OP_PACKLS:  return "packls";
+        case OP_UNPACK:  return "unpack";
+    }
+    return "?";
+}
+
+static void printStatus(const BatchOp *op, const char *error) {
+    printf("{\"op\":\"%s\",\"path\":", opName(op->type));
+    printJSONString(op->root);
+    if (error) {
+        printf(",\"status\":\"error\",\"error\":");
+        printJSONString(error);
+    } else {
+        printf(",\"status\":\"ok\"");
+        if (op->type == OP_SEARCH || op->type == OP_CLEANUP || op->type == OP_LIST ||
+            op->type == OP_PACKLS || op->type == OP_UNPACK)
+            printf(",\"count\":%ld", op->matches);
+        if (op->type == OP_PACK)
+            printf(",\"count\":%ld,\"removed\":%ld", op->matches, op->removed);
+        if (op->type == OP_REPORT) {
+            long long apparent = 0, allocated = 0;
+            for (int i = 0; i < op->fileCount; i++) {
+                apparent += op->files[i].size;
+                allocated += op->files[i].allocated;
+            }
+            printf(",\"count\":%d,\"bytes\":%lld,\"allocated\":%lld",
+                   op->fileCount, apparent, allocated);
+        }
+    }
+    printf("}\n");
+}
+
+// ===============================================================
+// ARGUMENT PARSING
+// ===============================================================
+static int parseOp(int argc, char *argv[], BatchOp *op) {
+    memset(op, 0, sizeof(*op));
+    op->sortChoice = 1;
+    op->limit = (size_t)-1;
+    op->maxSize = -1;
+
+    if (argc < 1) return -1;
+    const char *cmd = argv[0];
+    char *pos[2] = { NULL, NULL };
+    int npos = 0;
+
+    if      (strcmp(cmd, "list") == 0)    op->type = OP_LIST;
+    else if (strcmp(cmd, "search") == 0)  op->type = OP_SEARCH;
+    else if (strcmp(cmd, "report") == 0)  op->type = OP_REPORT;
+    else if (strcmp(cmd, "cleanup") == 0) op->type = OP_CLEANUP;
+    else if (strcmp(cmd, "copy") == 0)    op->type = OP_COPY;
+    else if (strcmp(cmd, "move") == 0)    op->type = OP_MOVE;
+    else if (strcmp(cmd, "rm") == 0)      op->type = OP_RM;
+    else if (strcmp(cmd, "pack") == 0)    op->type = OP_PACK;
+    else if (strcmp(cmd, "packls") == 0)  op->type = OP_PACKLS;
+    else if (strcmp(cmd, "unpack") == 0)  op->type = OP_UNPACK;
+    else {
+        fprintf(stderr, "Unknown command: %s\n", cmd);
+        return -1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(a, "--sort") == 0 && val) {
+            if (strcmp(val, "size") == 0) op->sortChoice = 2;
+            else if (strcmp(val, "date") == 0) op->sortChoice = 3;
+            else op->sortChoice = 1;
+            i++;
+        } else if (strcmp(a, "--offset") == 0 && val) {
+            op->offset = strtoul(val, NULL, 10); i++;
+        } else if (strcmp(a, "--limit") == 0 && val) {
+            op->limit = strtoul(val, NULL, 10); i++;
+        } else if (strcmp(a, "--txt") == 0 && val) {
+            snprintf(op->txtFile, sizeof(op->txtFile), "%s", val); i++;
+        } else if (strcmp(a, "--csv") == 0 && val) {
+            snprintf(op->csvFile, sizeof(op->csvFile), "%s", val); i++;
+        } else if (strcmp(a, "--min-size") == 0 && val) {
+            op->sizeLimit = strtol(val, NULL, 10); i++;
+        } else if (strcmp(a, "--max-size") == 0 && val) {
+            op->maxSize = strtol(val, NULL, 10); i++;
+        } else if (strcmp(a, "--to") == 0 && val) {
+            snprintf(op->destDir, sizeof(op->destDir), "%s", val); i++;
+        } else if (strcmp(a, "--min-age") == 0 && val) {
+            op->daysOld = atoi(val); i++;
+        } else if (strcmp(a, "--delete") == 0) {
+            op->doDelete = 1;
+        } else if (strcmp(a, "-r") == 0) {
+            op->recursive = 1;
+        } else if (a[0] == '-' && a[1] != '\0') {
+            fprintf(stderr, "%s: unknown or incomplete option %s\n", cmd, a);
+            return -1;
+        } else if (npos < 2) {
+            pos[npos++] = argv[i];
+        } else {
+            fprintf(stderr, "%s: too many arguments\n", cmd);
+            return -1;
+        }
+    }
+
+    int needed = (op->type == OP_SEARCH || op->type == OP_COPY || op->type == OP_MOVE ||
+                  op->type == OP_PACK) ? 2 : 1;
+    if (op->type == OP_UNPACK && npos == 2) needed = 2;     // optional NAME
+    if (npos != needed) {
+        fprintf(stderr, "%s: expected %d path argument(s)\n", cmd, needed);
+        return -1;
+    }
+
+    snprintf(op->root, sizeof(op->root), "%s", pos[0]);
+    if (needed == 2)
+        snprintf(op->arg, sizeof(op->arg), "%s", pos[1]);
+
+    if (op->type == OP_PACK && op->maxSize < 0)
+        op->maxSize = PACK_DEFAULT_MAX_SIZE;
+    if (op->type == OP_UNPACK && !op->destDir[0])
+        strcpy(op->destDir, ".");
+
+    if (op->type == OP_REPORT && !op->txtFile[0] && !op->csvFile[0]) {
+        strcpy(op->txtFile, "report.txt");
+        strcpy(op->csvFile, "report.csv");
+    }
+    return 0;
+}
+
+// Split a batch line into words. Double quotes group words; '#' starts a comment.
+int tokenizeLine(char *line, char *argv[], int maxArgs) {
+    int argc = 0;
+    char *p = line;
+
+    while (*p && argc < maxArgs) {
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p || *p == '#') break;
+
+        if (*p == '"') {
+            argv[argc++] = ++p;
+            while (*p && *p != '"') p++;
+        } else {
+            argv[argc++] = p;
+            while (*p && !isspace((unsigned char)*p)) p++;
+        }
+        if (*p) *p++ = '\0';
+    }
+    return argc;
+}
+
+// ===============================================================
+// SHARED TRAVERSAL (producer / consumer)
+// ===============================================================
+typedef struct WalkEntry {
+    char path[PATH_MAX];
+    int nameOffset;     // start of the file name inside path
+    int depth;          // 0 = directly inside the root
+    int duplicate;      // this file's data was already walked (link or hardlink)
+    int primary;        // first real path to it: may be deleted or packed
+    struct stat st;
+} WalkEntry;
+
+// Directory still to be read by one of the walker threads
+typedef struct WalkTask {
+    char *path;
+    int depth;
+    dev_t dev;
+    int viaLink;        // reached through a directory symlink
+    struct WalkTask *next;
+} WalkTask;
+
+typedef struct WalkQueue {
+    WalkEntry *slots;
+    int head, tail;
+    sem_t freeSlots;
+    sem_t usedSlots;
+    pthread_mutex_t pushLock;   // several walkers produce
+    const char *root;
+    int rootError;
+    TraversalState ts;          // visited set is thread safe (per-shard locks)
+    WalkTask *tasks;            // directories not yet claimed
+    int pending;                // queued + being read
+    pthread_mutex_t taskLock;
+    pthread_cond_t taskReady;
+} WalkQueue;
+
+static void queuePush(WalkQueue *q, const WalkEntry *e) {
+    sem_wait(&q->freeSlots);
+    pthread_mutex_lock(&q->pushLock);
+    q->slots[q->tail] = *e;
+    q->tail = (q->tail + 1) % WALK_QUEUE_SIZE;
+    pthread_mutex_unlock(&q->pushLock);
+    sem_post(&q->usedSlots);
+}
+
+static int pushTask(WalkQueue *q, const char *path, int depth, dev_t dev, int viaLink) {
+    WalkTask *t = malloc(sizeof(WalkTask));
+    if (!t || !(t->path = strdup(path))) {
+        free(t);
+        return -1;
+    }
+    t->depth = depth;
+    t->dev = dev;
+    t->viaLink = viaLink;
+
+    pthread_mutex_lock(&q->taskLock);
+    t->next = q->tasks;
+    q->tasks = t;
+    q->pending++;
+    pthread_cond_signal(&q->taskReady);
+    pthread_mutex_unlock(&q->taskLock);
+    return 0;
+}
+
+// Next directory to read, or NULL once every directory is done
+static WalkTask *popTask(WalkQueue *q) {
+    pthread_mutex_lock(&q->taskLock);
+    while (!q->tasks && q->pending > 0)
+        pthread_cond_wait(&q->taskReady, &q->taskLock);
+    WalkTask *t = q->tasks;
+    if (t) q->tasks = t->next;
+    pthread_mutex_unlock(&q->taskLock);
+    return t;
+}
+
+static void finishTask(WalkQueue *q, WalkTask *t) {
+    pthread_mutex_lock(&q->taskLock);
+    if (--q->pending == 0) pthread_cond_broadcast(&q->taskReady);
+    pthread_mutex_unlock(&q->taskLock);
+    free(t->path);
+    free(t);
+}
+
+static void walkDir(WalkQueue *q, const WalkTask *t) {
+    DirListing dl;
+    WalkEntry e;
+    const char *path = t->path;
+    int depth = t->depth;
+
+    DeviceProfile *d = deviceFor(t->dev, path);
+    unsigned long long t0 = deviceAcquire(d, DEV_LANE_WALK);
+    int rc = readDirListing(path, traversalPolicy.followSymlinks, &dl);
+    deviceRelease(d, DEV_LANE_WALK, t0, rc == 0 ? (unsigned long long)dl.count : 0);
+
+    if (rc != 0) {
+        if (depth == 0) q->rootError = errno;
+        return;
+    }
+
+    for (int i = 0; i < dl.count; i++) {
+        if (dl.err[i] != 0)
+            continue;
+
+        int n = snprintf(e.path, sizeof(e.path), "%s/%s", path, dl.names[i]);
+        if (n < 0 || n >= (int)sizeof(e.path))
+            continue;
+
+        e.st = dl.st[i];
+        int linked = t->viaLink || dl.isLink[i];
+
+        if (S_ISDIR(e.st.st_mode)) {
+            if (traversalEnterDir(&q->ts, &e.st, linked) &&
+                pushTask(q, e.path, depth + 1, e.st.st_dev, linked) != 0)
+                perror("Error queueing directory");
+        } else if (S_ISREG(e.st.st_mode)) {
+            e.nameOffset = n - (int)strlen(dl.names[i]);
+            e.depth = depth;
+            e.duplicate = !traversalFirstVisit(&q->ts, &e.st, linked);
+            e.primary = traversalPrimaryPath(&q->ts, &e.st, linked);
+            queuePush(q, &e);
+        }
+    }
+
+    freeDirListing(&dl);
+}
+
+static void *walkerThread(void *arg) {
+    WalkQueue *q = arg;
+    WalkTask *t;
+
+    while ((t = popTask(q)) != NULL) {
+        walkDir(q, t);
+        finishTask(q, t);
+    }
+    return NULL;
+}
+
+// Runs the walker pool over q->root, then queues the end-of-walk marker
+static void *walkCoordinator(void *arg) {
+    WalkQueue *q = arg;
+    pthread_t workers[DEVICE_MAX_JOBS];
+    int started = 0;
+    WalkEntry end;
+
+    if (traversalStart(&q->ts, q->root) != 0) {
+        q->rootError = errno;
+    } else if (pushTask(q, q->root, 0, q->ts.rootDev, 0) != 0) {
+        q->rootError = ENOMEM;
+    } else {
+        for (; started < deviceConfig.maxJobs; started++)
+            if (pthread_create(&workers[started], NULL, walkerThread, q) != 0) break;
+        if (started == 0) walkerThread(q);
+        for (int i = 0; i < started; i++)
+            pthread_join(workers[i], NULL);
+    }
+    traversalEnd(&q->ts);
+
+    end.depth = -1;     // end-of-walk marker
+    queuePush(q, &end);
+    return NULL;
+}
+
+static int appendFileInfo(BatchOp *op, const WalkEntry *e) {
+    if (op->fileCount == op->fileCap) {
+        int newCap = op->fileCap ? op->fileCap * 2 : 1024;
+        FileInfo *grown = realloc(op->files, sizeof(FileInfo) * newCap);
+        if (!grown) return -1;
+        op->files = grown;
+        op->fileCap = newCap;
+    }
+    fillFileInfo(&op->files[op->fileCount++], e->path, &e->st);
+    return 0;
+}
+
+static int appendVictim(BatchOp *op, const WalkEntry *e) {
+    if (op->victimCount == op->victimCap) {
+        int newCap = op->victimCap ? op->victimCap * 2 : 64;
+        Victim *grown = realloc(op->victims, sizeof(Victim) * newCap);
+        if (!grown) return -1;
+        op->victims = grown;
+        op->victimCap = newCap;
+    }
+    Victim *v = &op->victims[op->victimCount++];
+    snprintf(v->path, sizeof(v->path), "%s", e->path);
+    v->st = e->st;
+    return 0;
+}
+
+// Dispatch one walked file to every op in the group.
+static void visitEntry(BatchOp *ops[], int nops, const WalkEntry *e, time_t now) {
+    const char *name = e->path + e->nameOffset;
+
+    for (int i = 0; i < nops; i++) {
+        BatchOp *op = ops[i];
+
+        switch (op->type) {
+            case OP_SEARCH:
+                if (strstr(name, op->arg) != NULL) {
+                    printf("{\"op\":\"search\",\"match\":");
+                    printJSONString(e->path);
+                    printf("}\n");
+                    op->matches++;
+                }
+                break;
+
+            case OP_REPORT:
+                // Links and hardlinks count once so totals match real usage
+                if (e->duplicate) break;
+                if (appendFileInfo(op, e) != 0) op->failed = 1;
+                break;
+
+            case OP_CLEANUP: {
+                // Same criteria as the interactive SRU filter (top level only).
+                // Deleting a symlink frees nothing, so only real files qualify.
+                if (e->depth != 0 || !e->primary) break;
+                double ageInDays = difftime(now, e->st.st_mtime) / (60 * 60 * 24);
+                if (e->st.st_size > op->sizeLimit && ageInDays > op->daysOld) {
+                    printf("{\"op\":\"cleanup\",\"suggest\":");
+                    printJSONString(e->path);
+                    printf(",\"size\":%ld,\"age_days\":%.1f}\n", (long)e->st.st_size, ageInDays);
+                    op->matches++;
+                    if (op->doDelete && appendVictim(op, e) != 0) op->failed = 1;
+                }
+                break;
+            }
+
+            case OP_PACK: {
+                // Cold small files; multiply-linked files and symlinks stay where they are
+                if (!op->pack || !e->primary || e->st.st_nlink > 1 ||
+                    packIsSelf(op->pack, &e->st))
+                    break;
+                double ageInDays = difftime(now, e->st.st_mtime) / (60 * 60 * 24);
+                if (e->st.st_size > op->maxSize || ageInDays <= op->daysOld) break;
+
+                const char *rel = e->path + strlen(op->root);
+                while (*rel == '/') rel++;
+                if (packAppendFile(op->pack, e->path, rel, &e->st) != 0) {
+                    op->packErrors++;
+                    break;
+                }
+                op->matches++;
+                if (op->doDelete && appendVictim(op, e) != 0) op->failed = 1;
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+}
+
+// Same file, unchanged since 'was' was taken? Nanosecond timestamps:
+// a rewrite within the same second keeps st_mtime, and ctime catches
+// writers that reset the mtime afterwards.
+static int sameFileUnchanged(const struct stat *was, const struct stat *now) {
+    return was->st_dev == now->st_dev && was->st_ino == now->st_ino &&
+           was->st_size == now->st_size &&
+           was->st_mtim.tv_sec == now->st_mtim.tv_sec &&
+           was->st_mtim.tv_nsec == now->st_mtim.tv_nsec &&
+           was->st_ctim.tv_sec == now->st_ctim.tv_sec &&
+           was->st_ctim.tv_nsec == now->st_ctim.tv_nsec;
+}
+
+// Remove originals that are now safely in the (committed) pack. A file
+// that changed or was replaced since the walk looked at it (before it
+// was read into the pack), or is no longer a plain file, stays.
+static void removePackedOriginals(BatchOp *op) {
+    for (int i = 0; i < op->victimCount; i++) {
+        const Victim *v = &op->victims[i];
+        const char *rel = v->path + strlen(op->root);
+        while (*rel == '/') rel++;
+
+        const PackEntry *pe = packFind(op->pack, rel);
+        struct stat st;
+        if (!pe || metLstat(v->path, &st) != 0 || !S_ISREG(st.st_mode) ||
+            st.st_size != pe->size || !sameFileUnchanged(&v->st, &st))
+            continue;
+
+        struct passwd *pw = metGetpwuid(st.st_uid);
+        if (deleteFile(v->path) == 0) {
+            appendSRULogChecksum("ARCHIVED", v->path, (long)st.st_size,
+                                 pw ? pw->pw_name : "unknown", pe->crc);
+            op->removed++;
+        } else {
+            op->failed = 1;
+        }
+    }
+}
+
+static void finishOp(BatchOp *op) {
+    if (op->failed) {
+        printStatus(op, (op->type == OP_PACK && !op->pack) ? "unable to open pack" : "out of memory");
+    } else if (op->type == OP_PACK) {
+        // Originals go only after the new index is durable
+        if (packCommit(op->pack) != 0) {
+            op->failed = 1;
+            printStatus(op, "unable to write pack");
+        } else {
+            if (op->doDelete) removePackedOriginals(op);
+            if (op->packErrors) op->failed = 1;
+            printStatus(op, op->packErrors ? "some files could not be packed" :
+                            op->failed ? "some removals failed" : NULL);
+        }
+    } else if (op->type == OP_REPORT) {
+        if (op->txtFile[0] && writeReportTXT(op->root, op->files, op->fileCount, op->txtFile) != 0)
+            op->failed = 1;
+        if (op->csvFile[0] && writeReportCSV(op->files, op->fileCount, op->csvFile) != 0)
+            op->failed = 1;
+        printStatus(op, op->failed ? "unable to write report" : NULL);
+    } else if (op->type == OP_CLEANUP && op->doDelete) {
+        // Deletions happen after the walk so the tree is not mutated under it
+        for (int i = 0; i < op->victimCount; i++) {
+            struct stat st;
+            const char *owner = "unknown";
+            long size = 0;
+            if (metStat(op->victims[i].path, &st) == 0) {
+                struct passwd *pw = metGetpwuid(st.st_uid);
+                if (pw) owner = pw->pw_name;
+                size = (long)st.st_size;
+            }
+
+            if (deleteFile(op->victims[i].path) == 0) {
+                appendSRULog("DELETED", op->victims[i].path, size, owner);
+                printf("{\"op\":\"cleanup\",\"deleted\":");
+                printJSONString(op->victims[i].path);
+                printf("}\n");
+            } else {
+                op->failed = 1;
+            }
+        }
+        printStatus(op, op->failed ? "some deletions failed" : NULL);
+    } else {
+        printStatus(op, NULL);
+    }
+
+    free(op->files);
+    free(op->victims);
+    packClose(op->pack);
+    op->files = NULL;
+    op->victims = NULL;
+    op->pack = NULL;
+}
+
+// Run every op in 'ops' with one traversal of their common root.
+static void runSharedWalk(BatchOp *ops[], int nops) {
+    WalkQueue q;
+    pthread_t walker;
+    time_t now = time(NULL);
+
+    memset(&q, 0, sizeof(q));
+    q.root = ops[0]->root;
+    q.slots = malloc(sizeof(WalkEntry) * WALK_QUEUE_SIZE);
+    if (!q.slots) {
+        for (int i = 0; i < nops; i++) { ops[i]->failed = 1; finishOp(ops[i]); }
+        return;
+    }
+    sem_init(&q.freeSlots, 0, WALK_QUEUE_SIZE);
+    sem_init(&q.usedSlots, 0, 0);
+    pthread_mutex_init(&q.pushLock, NULL);
+    pthread_mutex_init(&q.taskLock, NULL);
+    pthread_cond_init(&q.taskReady, NULL);
+
+    for (int i = 0; i < nops; i++) {
+        if (ops[i]->type == OP_PACK && !(ops[i]->pack = packOpen(ops[i]->arg, 1)))
+            ops[i]->failed = 1;
+    }
+
+    int rc = pthread_create(&walker, NULL, walkCoordinator, &q);
+    if (rc != 0) {
+        q.rootError = rc;
+    } else {
+        for (;;) {
+            sem_wait(&q.usedSlots);
+            WalkEntry *e = &q.slots[q.head];
+            if (e->depth < 0) break;
+            visitEntry(ops, nops, e, now);
+            q.head = (q.head + 1) % WALK_QUEUE_SIZE;
+            sem_post(&q.freeSlots);
+        }
+        pthread_join(walker, NULL);
+    }
+    sem_destroy(&q.freeSlots);
+    sem_destroy(&q.usedSlots);
+    pthread_mutex_destroy(&q.pushLock);
+    pthread_mutex_destroy(&q.taskLock);
+    pthread_cond_destroy(&q.taskReady);
+    free(q.slots);
+
+    for (int i = 0; i < nops; i++) {
+        if (q.rootError) {
+            printStatus(ops[i], strerror(q.rootError));
+            ops[i]->failed = 1;
+            free(ops[i]->files);
+            free(ops[i]->victims);
+            packClose(ops[i]->pack);
+        } else {
+            finishOp(ops[i]);
+        }
+    }
+}
+
+// ===============================================================
+// SINGLE (NON-TRAVERSAL) OPERATIONS
+// ===============================================================
+static void runList(BatchOp *op) {
+    DirSnapshot *snap = openDirSnapshot(op->root, op->sortChoice);
+    if (!snap) {
+        op->failed = 1;
+        printStatus(op, strerror(errno));
+        return;
+    }
+
+    FileInfo page[256];
+    size_t offset = op->offset, remaining = op->limit, n;
+    while (remaining > 0 &&
+           (n = fetchDirPage(snap, offset, remaining < 256 ? remaining : 256, page)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            printf("{\"op\":\"list\",\"name\":");
+            printJSONString(page[i].name);
+            printf(",\"size\":%ld,\"allocated\":%ld,\"owner\":",
+                   (long)page[i].size, (long)page[i].allocated);
+            printJSONString(page[i].owner);
+            printf(",\"group\":");
+            printJSONString(page[i].group);
+            printf(",\"mtime\":%ld}\n", (long)page[i].modified);
+        }
+        offset += n;
+        remaining -= n;
+        op->matches += n;
+    }
+
+    closeDirSnapshot(snap);
+    printStatus(op, NULL);
+}
+
+static void runPackList(BatchOp *op) {
+    Pack *pack = packOpen(op->root, 0);
+    if (!pack) {
+        op->failed = 1;
+        printStatus(op, "unable to open pack");
+        return;
+    }
+
+    for (int i = 0; i < packEntryCount(pack); i++) {
+        const PackEntry *e = packEntryAt(pack, i);
+        printf("{\"op\":\"packls\",\"name\":");
+        printJSONString(e->name);
+        printf(",\"size\":%ld,\"mtime\":%ld,\"mode\":\"%04o\",\"crc32c\":\"%08x\"}\n",
+               (long)e->size, (long)e->mtime, (unsigned)e->mode, e->crc);
+        op->matches++;
+    }
+
+    packClose(pack);
+    printStatus(op, NULL);
+}
+
+// Extract one named entry (random access through the index) or all
+static void runUnpack(BatchOp *op) {
+    Pack *pack = packOpen(op->root, 0);
+    if (!pack) {
+        op->failed = 1;
+        printStatus(op, "unable to open pack");
+        return;
+    }
+
+    const PackEntry *one = NULL;
+    if (op->arg[0] && !(one = packFind(pack, op->arg))) {
+        packClose(pack);
+        op->failed = 1;
+        printStatus(op, "no such entry in pack");
+        return;
+    }
+
+    int n = one ? 1 : packEntryCount(pack);
+    for (int i = 0; i < n; i++) {
+        const PackEntry *e = one ? one : packEntryAt(pack, i);
+        if (packExtract(pack, e, op->destDir) != 0) {
+            op->failed = 1;
+            continue;
+        }
+        printf("{\"op\":\"unpack\",\"extracted\":");
+        printJSONString(e->name);
+        printf("}\n");
+        op->matches++;
+    }
+
+    packClose(pack);
+    printStatus(op, op->failed ? "some entries could not be extracted" : NULL);
+}
+
+static void runSingle(BatchOp *op) {
+    int rc = 0;
+
+    switch (op->type) {
+        case OP_LIST:
+            runList(op);
+            return;
+        case OP_PACKLS:
+            runPackList(op);
+            return;
+        case OP_UNPACK:
+            runUnpack(op);
+            return;
+        case OP_COPY:
+            rc = copyFile(op->root, op->arg);
+            break;
+        case OP_MOVE:
+            rc = moveFile(op->root, op->arg);
+            break;
+        case OP_RM:
+            rc = op->recursive ? removeDirectoryRecursive(op->root) : deleteFile(op->root);
+            break;
+        default:
+            return;
+    }
+
+    if (rc != 0) op->failed = 1;
+    printStatus(op, rc != 0 ? strerror(errno) : NULL);
+}
+
+static int isTraversalOp(const BatchOp *op) {
+    return op->type == OP_SEARCH || op->type == OP_REPORT || op->type == OP_CLEANUP ||
+           op->type == OP_PACK;
+}
+
+// Execute ops in order. Adjacent traversal ops on the same root share one
+// walk; list/copy/move/rm act as barriers, and so does any op with
+// --delete (it ends its group, so later ops see the tree after deletion).
+static int runOps(BatchOp ops[], int nops) {
+    BatchOp *group[MAX_BATCH_OPS];
+    int failed = 0;
+    int i = 0;
+
+    while (i < nops) {
+        if (!isTraversalOp(&ops[i])) {
+            runSingle(&ops[i]);
+            failed |= ops[i].failed;
+            i++;
+            continue;
+        }
+
+        int n = 0;
+        do {
+            group[n++] = &ops[i++];
+        } while (!group[n - 1]->doDelete && i < nops && n < MAX_BATCH_OPS &&
+                 isTraversalOp(&ops[i]) && strcmp(ops[i].root, group[0]->root) == 0);
+
+        runSharedWalk(group, n);
+        for (int k = 0; k < n; k++) failed |= group[k]->failed;
+    }
+
+    fflush(stdout);
+    return failed ? EXIT_OP_FAILED : 0;
+}
+
+// ===============================================================
+// PUBLIC ENTRY POINTS
+// ===============================================================
+int runBatchFile(const char *batchfile) {
+    FILE *fp = strcmp(batchfile, "-") == 0 ? stdin : fopen(batchfile, "r");
+    if (!fp) {
+        perror("Unable to open batch file");
+        return EXIT_USAGE;
+    }
+
+    BatchOp *ops = malloc(sizeof(BatchOp) * MAX_BATCH_OPS);
+    if (!ops) {
+        if (fp != stdin) fclose(fp);
+        return EXIT_OP_FAILED;
+    }
+
+    char line[2 * PATH_MAX];
+    int nops = 0, lineno = 0, rc = 0;
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *argv[MAX_OP_ARGS];
+        lineno++;
+
+        int argc = tokenizeLine(line, argv, MAX_OP_ARGS);
+        if (argc == 0) continue;
+
+        if (nops >= MAX_BATCH_OPS) {
+            fprintf(stderr, "Batch file exceeds %d operations\n", MAX_BATCH_OPS);
+            rc = EXIT_USAGE;
+            break;
+        }
+        if (parseOp(argc, argv, &ops[nops]) != 0) {
+            fprintf(stderr, "%s:%d: invalid command\n", batchfile, lineno);
+            rc = EXIT_USAGE;
+            break;
+        }
+        nops++;
+    }
+
+    if (fp != stdin) fclose(fp);
+
+    if (rc == 0) rc = runOps(ops, nops);
+    free(ops);
+    return rc;
+}
+
+static int runCommand(int argc, char *argv[]) {
+    if (strcmp(argv[0], "--batch") == 0) {
+        if (argc != 2) {
+            fprintf(stderr, "usage: dir_manage --batch FILE\n");
+            return EXIT_USAGE;
+        }
+        return runBatchFile(argv[1]);
+    }
+    if (strcmp(argv[0], "serve") == 0)
+        return runDaemon(argc - 1, argv + 1);
+    if (strcmp(argv[0], "query") == 0)
+        return runDaemonQuery(argc - 1, argv + 1);
+
+    BatchOp *op = malloc(sizeof(BatchOp));
+    if (!op) return EXIT_OP_FAILED;
+
+    if (parseOp(argc, argv, op) != 0) {
+        fprintf(stderr, "usage: dir_manage [--metrics] [--metrics-file FILE] [-L|-P] [--xdev] [--io-uring] [--jobs N] [--max-ops N] [--max-mbps N] [--verify] "
+                        "list|search|report|cleanup|copy|move|rm|pack|packls|unpack ... | --batch FILE | serve ... | query ...\n");
+        free(op);
+        return EXIT_USAGE;
+    }
+
+    int rc = runOps(op, 1);
+    free(op);
+    return rc;
+}
+
+int runCommandLine(int argc, char *argv[]) {
+    const char *metricsFile = NULL;
+    int showMetrics = 0, used;
+
+    // Global options come before the command
+    while (argc > 0) {
+        if (strcmp(argv[0], "--metrics") == 0) {
+            showMetrics = 1;
+            argc--; argv++;
+        } else if (strcmp(argv[0], "--metrics-file") == 0 && argc > 1) {
+            metricsFile = argv[1];
+            argc -= 2; argv += 2;
+        } else if (strcmp(argv[0], "--verify") == 0) {
+            copyVerify = 1;
+            argc--; argv++;
+        } else if (parseTraversalFlag(argv[0])) {
+            argc--; argv++;
+        } else if ((used = parseIoBackendFlag(argc, argv)) > 0) {
+            argc -= used; argv += used;
+        } else if ((used = parseThrottleFlag(argc, argv)) > 0) {
+            argc -= used; argv += used;
+        } else if ((used = parseDeviceFlag(argc, argv)) > 0) {
+            argc -= used; argv += used;
+        } else {
+            break;
+        }
+    }
+    if (argc < 1) {
+        fprintf(stderr, "usage: dir_manage [--metrics] [--metrics-file FILE] COMMAND ...\n");
+        return EXIT_USAGE;
+    }
+
+    if (showMetrics || metricsFile) {
+        metricsReset();
+        metricsEnabled = 1;
+    }
+    if (applyThrottleConfig() != 0 && throttleConfig.idleIoPriority)
+        fprintf(stderr, "warning: continuing without idle I/O priority\n");
+
+    int rc = runCommand(argc, argv);
+
+    if (showMetrics) {
+        printMetricsSummary(stderr);
+        printDeviceSummary(stderr);
+    }
+    if (metricsFile && exportMetricsPrometheus(metricsFile) != 0 && rc == 0)
+        rc = EXIT_OP_FAILED;
+    return rc;
+}
@@ -0,0 +1,545 @@
+// bench.c
+// Benchmark harness for the directory management modules.
+//
+//   make bench && ./bench/bench [options]
+//
+// A deterministic tree is generated under --work (default ./bench_work),
+// then each operation is timed --runs times and the median is reported.
+// Keep the options identical between commits to compare results; --json
+// prints one JSON object per operation for scripted diffing.
+#define _GNU_SOURCE
+#include "../dir_manage.h"
+#include "gentree.h"
+#include <errno.h>
+#include <ftw.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define MAX_RUNS 32
+
+typedef enum { CACHE_WARM, CACHE_COLD } CacheMode;
+
+typedef struct BenchConfig {
+    TreeSpec spec;
+    char work[PATH_MAX / 4];
+    char pattern[128];
+    CacheMode cache;
+    int runs;
+    int json;
+    int keep;
+    int metrics;
+} BenchConfig;
+
+typedef struct BenchResult {
+    const char *op;
+    long files;
+    long long bytes;
+    double seconds;          // median over runs
+    double syscallsPerFile;  // -1 when unavailable
+    long peakRssKB;
+} BenchResult;
+
+static BenchConfig cfg;
+static TreeStats tree;
+// Half of PATH_MAX leaves room for the file names appended below them
+static char treeDir[PATH_MAX / 2], copyDir[PATH_MAX / 2], movedDir[PATH_MAX / 2];
+static char victimDir[PATH_MAX / 2], outDir[PATH_MAX / 2];
+
+// Regular files of the generated tree (copy/move inputs). Hardlinks are
+// in it too: each one is copied as a separate file.
+static char (*fileList)[PATH_MAX];
+static long fileListCount;
+static long long fileListBytes;
+
+// ===============================================================
+// MEASUREMENT HELPERS
+// ===============================================================
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Syscall counting: a raw_syscalls:sys_enter tracepoint counter when the
+// kernel allows it, otherwise the module's own instrumented call counts
+// (opendir/readdir/stat/open/read/write/unlink; see metrics.c).
+static int perfFd = -1;
+static const char *syscallSource = "none";
+
+static void openSyscallCounter(void) {
+    const char *idFiles[] = {
+        "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+        "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+    };
+
+    for (size_t i = 0; i < sizeof(idFiles) / sizeof(idFiles[0]); i++) {
+        FILE *fp = fopen(idFiles[i], "r");
+        long id;
+        if (!fp) continue;
+        int ok = fscanf(fp, "%ld", &id) == 1;
+        fclose(fp);
+        if (!ok) continue;
+
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.size = sizeof(attr);
+        attr.config = (uint64_t)id;
+        attr.inherit = 1;           // include the batch walker threads
+        attr.exclude_kernel = 0;
+
+        perfFd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (perfFd >= 0) {
+            syscallSource = "perf";
+            return;
+        }
+    }
+
+    metricsEnabled = 1;
+    syscallSource = "instrumented";
+}
+
+static long long readSyscallCount(void) {
+    if (perfFd >= 0) {
+        uint64_t v;
+        if (read(perfFd, &v, sizeof(v)) == sizeof(v)) return (long long)v;
+        return -1;
+    }
+
+    MetricsSummary m;
+    long long total = 0;
+    metricsSnapshot(&m);
+    for (int c = 0; c < MET_NUM_CLASSES; c++) {
+        if (c == MET_FORMAT || c == MET_LOCK_WAIT || c == MET_NAME_LOOKUP ||
+            c == MET_THROTTLE_WAIT) continue;
+        total += (long long)m.count[c];
+    }
+    return total;
+}
+
+// Reset the peak RSS watermark (Linux >= 4.0) so each op gets its own peak
+static void resetPeakRss(void) {
+    FILE *fp = fopen("/proc/self/clear_refs", "w");
+    if (!fp) return;
+    fputs("5", fp);
+    fclose(fp);
+}
+
+static long readPeakRssKB(void) {
+    FILE *fp = fopen("/proc/self/status", "r");
+    char line[256];
+    long kb = -1;
+
+    if (fp) {
+        while (fgets(line, sizeof(line), fp)) {
+            if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) break;
+        }
+        fclose(fp);
+    }
+    if (kb < 0) {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        kb = ru.ru_maxrss;
+    }
+    return kb;
+}
+
+static int dropCaches(void) {
+    sync();
+    FILE *fp = fopen("/proc/sys/vm/drop_caches", "w");
+    if (!fp) return -1;
+    int ok = fputs("3", fp) >= 0;
+    return (fclose(fp) == 0 && ok) ? 0 : -1;
+}
+
+// The modules print to stdout; send that to /dev/null while timing.
+static int savedStdout = -1;
+
+static void silenceStdout(void) {
+    fflush(stdout);
+    savedStdout = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0) {
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+    }
+}
+
+static void restoreStdout(void) {
+    fflush(stdout);
+    if (savedStdout >= 0) {
+        dup2(savedStdout, STDOUT_FILENO);
+        close(savedStdout);
+        savedStdout = -1;
+    }
+}
+
+// ===============================================================
+// TREE HELPERS
+// ===============================================================
+static int rmTreeEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static void rmTree(const char *path) {
+    if (access(path, F_OK) == 0)
+        nftw(path, rmTreeEntry, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+static int collectEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)ftw;
+    if (flag == FTW_F && S_ISREG(st->st_mode)) {
+        if (fileList)
+            snprintf(fileList[fileListCount], PATH_MAX, "%s", path);
+        fileListCount++;
+        fileListBytes += st->st_size;
+    }
+    return 0;
+}
+
+static int warmEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)path; (void)st; (void)flag; (void)ftw;
+    return 0;
+}
+
+static void prepareCache(const char *dir) {
+    if (cfg.cache == CACHE_COLD) {
+        dropCaches();
+    } else {
+        nftw(dir, warmEntry, 64, FTW_PHYS);
+    }
+}
+
+static int copyAll(const char *dstDir) {
+    char dst[PATH_MAX];
+    mkdir(dstDir, 0755);
+    for (long i = 0; i < fileListCount; i++) {
+        snprintf(dst, sizeof(dst), "%s/c%07ld", dstDir, i);
+        if (copyFile(fileList[i], dst) != 0) return -1;
+    }
+    return 0;
+}
+
+static int moveAll(const char *srcDir, const char *dstDir) {
+    char src[PATH_MAX], dst[PATH_MAX];
+    mkdir(dstDir, 0755);
+    for (long i = 0; i < fileListCount; i++) {
+        snprintf(src, sizeof(src), "%s/c%07ld", srcDir, i);
+        snprintf(dst, sizeof(dst), "%s/c%07ld", dstDir, i);
+        if (moveFile(src, dst) != 0) return -1;
+    }
+    return 0;
+}
+
+// ===============================================================
+// OPERATIONS
+// ===============================================================
+typedef enum { OPB_LIST, OPB_SEARCH, OPB_REPORT, OPB_SRU, OPB_COPY, OPB_MOVE, OPB_DELETE } BenchOp;
+
+static const char *benchOpNames[] = { "list", "search", "report", "sru", "copy", "move", "delete" };
+
+static void prepareOp(BenchOp op) {
+    TreeStats ignored;
+
+    switch (op) {
+        case OPB_COPY:
+            rmTree(copyDir);
+            prepareCache(treeDir);
+            break;
+        case OPB_MOVE:
+            rmTree(movedDir);
+            rmTree(copyDir);
+            copyAll(copyDir);
+            prepareCache(copyDir);
+            break;
+        case OPB_DELETE:
+            rmTree(victimDir);
+            generateTree(victimDir, &cfg.spec, &ignored);
+            prepareCache(victimDir);
+            break;
+        default:
+            prepareCache(treeDir);
+            break;
+    }
+}
+
+static int runOp(BenchOp op) {
+    char txt[PATH_MAX], csv[PATH_MAX];
+
+    switch (op) {
+        case OPB_LIST: {
+            char *argv[] = { "list", treeDir };
+            return runCommandLine(2, argv);
+        }
+        case OPB_SEARCH:
+            searchByNameOrExtension(treeDir, cfg.pattern);
+            return 0;
+        case OPB_REPORT:
+            snprintf(txt, sizeof(txt), "%s/report.txt", outDir);
+            snprintf(csv, sizeof(csv), "%s/report.csv", outDir);
+            exportReportTXT(treeDir, txt);
+            exportReportCSV(treeDir, csv);
+            return 0;
+        case OPB_SRU: {
+            char *argv[] = { "cleanup", treeDir, "--min-size", "4096", "--min-age", "30" };
+            return runCommandLine(6, argv);
+        }
+        case OPB_COPY:
+            return copyAll(copyDir);
+        case OPB_MOVE:
+            return moveAll(copyDir, movedDir);
+        case OPB_DELETE:
+            return removeDirectoryRecursive(victimDir);
+    }
+    return -1;
+}
+
+// Files and bytes each op is expected to touch (for the rate columns)
+static void opVolume(BenchOp op, long *files, long long *bytes) {
+    long entries = tree.files + tree.hardlinks + tree.symlinks;
+    *bytes = 0;
+
+    switch (op) {
+        case OPB_LIST:   *files = cfg.spec.filesPerDir; break;
+        case OPB_COPY:   *files = fileListCount; *bytes = fileListBytes; break;
+        // Source and destination share a file system, so move is rename(2):
+        // no data is transferred and only the file rate is meaningful
+        case OPB_MOVE:   *files = fileListCount; break;
+        case OPB_DELETE: *files = entries + tree.dirs; break;
+        default:         *files = entries; break;
+    }
+}
+
+static int compareDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int benchOne(BenchOp op, BenchResult *res) {
+    double times[MAX_RUNS];
+    long long calls = 0;
+    int callsOk = 1;
+
+    memset(res, 0, sizeof(*res));
+    res->op = benchOpNames[op];
+    opVolume(op, &res->files, &res->bytes);
+
+    for (int r = 0; r < cfg.runs; r++) {
+        prepareOp(op);
+        resetPeakRss();
+        if (cfg.metrics && r == cfg.runs - 1) metricsReset();
+
+        silenceStdout();
+        long long before = readSyscallCount();
+        double t0 = nowSeconds();
+        int rc = runOp(op);
+        double t1 = nowSeconds();
+        long long after = readSyscallCount();
+        restoreStdout();
+
+        if (rc != 0) {
+            fprintf(stderr, "bench: %s failed (rc=%d)\n", res->op, rc);
+            return -1;
+        }
+
+        times[r] = t1 - t0;
+        if (before < 0 || after < 0) callsOk = 0;
+        else calls += after - before;
+
+        long rss = readPeakRssKB();
+        if (rss > res->peakRssKB) res->peakRssKB = rss;
+    }
+
+    if (cfg.metrics) {
+        fprintf(stderr, "[%s, last run]\n", res->op);
+        printMetricsSummary(stderr);
+    }
+
+    qsort(times, cfg.runs, sizeof(double), compareDouble);
+    res->seconds = times[cfg.runs / 2];
+    // rename(2) has no instrumented wrapper, so only perf can count it
+    if (op == OPB_MOVE && perfFd < 0) callsOk = 0;
+    res->syscallsPerFile = (callsOk && res->files > 0)
+        ? (double)calls / cfg.runs / res->files : -1;
+    return 0;
+}
+
+// ===============================================================
+// OUTPUT
+// ===============================================================
+static const char *sizeDistName(SizeDist d) {
+    switch (d) {
+        case SIZE_FIXED:   return "fixed";
+        case SIZE_UNIFORM: return "uniform";
+        case SIZE_SKEWED:  return "skewed";
+    }
+    return "?";
+}
+
+static void printHeader(void) {
+    if (cfg.json) return;
+
+    printf("# dir_manage bench: seed=%llu depth=%d fanout=%d files/dir=%d size=%s:%ld "
+           "long_names=%d hardlinks=%d%% symlinks=%d%% cache=%s runs=%d syscalls=%s io=%s\n",
+           (unsigned long long)cfg.spec.seed, cfg.spec.depth, cfg.spec.fanout,
+           cfg.spec.filesPerDir, sizeDistName(cfg.spec.sizeDist), (long)cfg.spec.sizeMean,
+           cfg.spec.longNames, cfg.spec.hardlinkPct, cfg.spec.symlinkPct,
+           cfg.cache == CACHE_COLD ? "cold" : "warm", cfg.runs, syscallSource,
+           ioUringAvailable() ? "io_uring" : "sync");
+    printf("# tree: dirs=%ld files=%ld hardlinks=%ld symlinks=%ld bytes=%lld\n",
+           tree.dirs, tree.files, tree.hardlinks, tree.symlinks, tree.bytes);
+    printf("%-8s %10s %12s %14s %10s %14s %12s\n",
+           "op", "files", "seconds", "files/s", "MB/s", "syscalls/file", "peak_rss_kb");
+}
+
+static void printResult(const BenchResult *r) {
+    double fps = r->seconds > 0 ? r->files / r->seconds : 0;
+    double mbps = (r->seconds > 0 && r->bytes > 0) ? r->bytes / r->seconds / (1024.0 * 1024.0) : 0;
+
+    if (cfg.json) {
+        printf("{\"op\":\"%s\",\"seed\":%llu,\"depth\":%d,\"fanout\":%d,\"files_per_dir\":%d,"
+               "\"size_dist\":\"%s\",\"size_mean\":%ld,\"cache\":\"%s\",\"runs\":%d,"
+               "\"files\":%ld,\"bytes\":%lld,\"seconds\":%.6f,\"files_per_sec\":%.1f,"
+               "\"mb_per_sec\":%.2f,\"syscalls_per_file\":%.2f,\"syscall_source\":\"%s\","
+               "\"peak_rss_kb\":%ld}\n",
+               r->op, (unsigned long long)cfg.spec.seed, cfg.spec.depth, cfg.spec.fanout,
+               cfg.spec.filesPerDir, sizeDistName(cfg.spec.sizeDist), (long)cfg.spec.sizeMean,
+               cfg.cache == CACHE_COLD ? "cold" : "warm", cfg.runs,
+               r->files, r->bytes, r->seconds, fps, mbps, r->syscallsPerFile,
+               syscallSource, r->peakRssKB);
+        return;
+    }
+
+    printf("%-8s %10ld %12.6f %14.1f ", r->op, r->files, r->seconds, fps);
+    if (r->bytes > 0) printf("%10.2f ", mbps);
+    else printf("%10s ", "n/a");
+    if (r->syscallsPerFile >= 0) printf("%14.2f", r->syscallsPerFile);
+    else printf("%14s", "n/a");
+    printf(" %12ld\n", r->peakRssKB);
+}
+
+// ===============================================================
+// MAIN
+// ===============================================================
+static void usage(void) {
+    fprintf(stderr,
+        "usage: bench [options] [op ...]\n"
+        "  ops: list search report sru copy move delete (default: all)\n"
+        "       move renames within the work directory (files/s only)\n"
+        "  --work DIR          scratch directory (default ./bench_work)\n"
+        "  --seed N --depth N --fanout N --files N\n"
+        "  --size-dist fixed|uniform|skewed  --size-mean BYTES\n"
+        "  --long-names --hardlinks PCT --symlinks PCT\n"
+        "  --pattern STR       search pattern (default 7.dat)\n"
+        "  --cache warm|cold   cold drops the page cache before each run (root)\n"
+        "  --runs N            repetitions, median is reported (default 3)\n"
+        "  --json              JSON lines output\n"
+        "  --keep              keep the scratch directory\n"
+        "  --metrics           per-op call-class breakdown on stderr\n"
+        "  --io-uring [--queue-depth N]  use the io_uring backend\n");
+}
+
+int main(int argc, char *argv[]) {
+    int selected[7] = { 0 };
+    int anySelected = 0, used;
+
+    defaultTreeSpec(&cfg.spec);
+    snprintf(cfg.work, sizeof(cfg.work), "bench_work");
+    snprintf(cfg.pattern, sizeof(cfg.pattern), "7.dat");
+    cfg.runs = 3;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if      (strcmp(a, "--work") == 0 && val)      { snprintf(cfg.work, sizeof(cfg.work), "%s", val); i++; }
+        else if (strcmp(a, "--seed") == 0 && val)      { cfg.spec.seed = strtoull(val, NULL, 10); i++; }
+        else if (strcmp(a, "--depth") == 0 && val)     { cfg.spec.depth = atoi(val); i++; }
+        else if (strcmp(a, "--fanout") == 0 && val)    { cfg.spec.fanout = atoi(val); i++; }
+        else if (strcmp(a, "--files") == 0 && val)     { cfg.spec.filesPerDir = atoi(val); i++; }
+        else if (strcmp(a, "--size-mean") == 0 && val) { cfg.spec.sizeMean = atol(val); i++; }
+        else if (strcmp(a, "--hardlinks") == 0 && val) { cfg.spec.hardlinkPct = atoi(val); i++; }
+        else if (strcmp(a, "--symlinks") == 0 && val)  { cfg.spec.symlinkPct = atoi(val); i++; }
+        else if (strcmp(a, "--pattern") == 0 && val)   { snprintf(cfg.pattern, sizeof(cfg.pattern), "%s", val); i++; }
+        else if (strcmp(a, "--runs") == 0 && val)      { cfg.runs = atoi(val); i++; }
+        else if (strcmp(a, "--long-names") == 0)       cfg.spec.longNames = 1;
+        else if (strcmp(a, "--json") == 0)             cfg.json = 1;
+        else if (strcmp(a, "--keep") == 0)             cfg.keep = 1;
+        else if (strcmp(a, "--metrics") == 0)          cfg.metrics = 1;
+        else if ((used = parseIoBackendFlag(argc - i, argv + i)) > 0) i += used - 1;
+        else if (strcmp(a, "--size-dist") == 0 && val) {
+            if (strcmp(val, "fixed") == 0) cfg.spec.sizeDist = SIZE_FIXED;
+            else if (strcmp(val, "uniform") == 0) cfg.spec.sizeDist = SIZE_UNIFORM;
+            else cfg.spec.sizeDist = SIZE_SKEWED;
+            i++;
+        } else if (strcmp(a, "--cache") == 0 && val) {
+            cfg.cache = strcmp(val, "cold") == 0 ? CACHE_COLD : CACHE_WARM;
+            i++;
+        } else {
+            int found = 0;
+            for (int k = 0; k < 7; k++) {
+                if (strcmp(a, benchOpNames[k]) == 0) { selected[k] = found = anySelected = 1; }
+            }
+            if (!found) { usage(); return EXIT_USAGE; }
+        }
+    }
+
+    if (cfg.runs < 1) cfg.runs = 1;
+    if (cfg.runs > MAX_RUNS) cfg.runs = MAX_RUNS;
+
+    if (cfg.cache == CACHE_COLD && dropCaches() != 0) {
+        fprintf(stderr, "bench: --cache cold needs write access to /proc/sys/vm/drop_caches\n");
+        return EXIT_OP_FAILED;
+    }
+
+    initSyncMechanisms();
+    openSyscallCounter();
+    if (cfg.metrics) metricsEnabled = 1;
+
+    // -------------------------------------------------------------
+    // Scratch layout: tree/ (input), copy/, moved/, victim/, out/
+    // -------------------------------------------------------------
+    rmTree(cfg.work);
+    if (mkdir(cfg.work, 0755) != 0) {
+        perror(cfg.work);
+        return EXIT_OP_FAILED;
+    }
+    snprintf(treeDir, sizeof(treeDir), "%s/tree", cfg.work);
+    snprintf(copyDir, sizeof(copyDir), "%s/copy", cfg.work);
+    snprintf(movedDir, sizeof(movedDir), "%s/moved", cfg.work);
+    snprintf(victimDir, sizeof(victimDir), "%s/victim", cfg.work);
+    snprintf(outDir, sizeof(outDir), "%s/out", cfg.work);
+    mkdir(outDir, 0755);
+
+    if (generateTree(treeDir, &cfg.spec, &tree) != 0) {
+        fprintf(stderr, "bench: tree generation failed\n");
+        return EXIT_OP_FAILED;
+    }
+
+    // Two passes: count, then fill the copy/move input list
+    nftw(treeDir, collectEntry, 64, FTW_PHYS);
+    fileList = malloc(sizeof(*fileList) * (fileListCount ? fileListCount : 1));
+    if (!fileList) return EXIT_OP_FAILED;
+    fileListCount = 0;
+    fileListBytes = 0;
+    nftw(treeDir, collectEntry, 64, FTW_PHYS);
+
+    printHeader();
+
+    int rc = 0;
+    for (int k = 0; k < 7; k++) {
+        BenchResult res;
+        if (anySelected && !selected[k]) continue;
+        if (benchOne((BenchOp)k, &res) != 0) { rc = EXIT_OP_FAILED; continue; }
+        printResult(&res);
+        fflush(stdout);
+    }
+
+    if (!cfg.keep) rmTree(cfg.work);
+    free(fileList);
+    destroySyncMechanisms();
+    return rc;
+}
@@ -0,0 +1,199 @@
+// gentree.c
+// Deterministic synthetic directory tree generator for the benchmarks.
+#define _GNU_SOURCE
+#include "gentree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define LINK_POOL      64      // recent files eligible as link targets
+#define FILL_BUF_SIZE  65536
+#define LONG_NAME_LEN  200
+
+typedef struct GenState {
+    const TreeSpec *spec;
+    TreeStats *stats;
+    uint64_t rng;
+    time_t now;
+    long nextId;
+    char pool[LINK_POOL][PATH_MAX];
+    int poolCount;
+    char fill[FILL_BUF_SIZE];
+} GenState;
+
+// xorshift64* - small, fast and identical on every platform
+static uint64_t nextRand(GenState *g) {
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+    return g->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static off_t pickSize(GenState *g) {
+    const TreeSpec *s = g->spec;
+
+    switch (s->sizeDist) {
+        case SIZE_FIXED:
+            return s->sizeMean;
+        case SIZE_UNIFORM:
+            return (off_t)(nextRand(g) % (uint64_t)(2 * s->sizeMean + 1));
+        case SIZE_SKEWED: {
+            // Scale 2^k with probability 2^-(k+1): many tiny files, long tail
+            uint64_t r = nextRand(g) | 1;
+            int halvings = __builtin_clzll(r);
+            off_t base = s->sizeMean / 4;
+            off_t size = base << (halvings > 20 ? 20 : halvings);
+            return (off_t)(nextRand(g) % (uint64_t)(size + 1));
+        }
+    }
+    return s->sizeMean;
+}
+
+static void makeName(GenState *g, char *out, size_t outLen, char prefix) {
+    long id = g->nextId++;
+
+    if (!g->spec->longNames) {
+        snprintf(out, outLen, "%c%07ld.dat", prefix, id);
+        return;
+    }
+
+    int n = snprintf(out, outLen, "%c%07ld_", prefix, id);
+    while (n < LONG_NAME_LEN && (size_t)n < outLen - 5)
+        out[n++] = (char)('a' + nextRand(g) % 26);
+    strcpy(out + n, ".dat");
+}
+
+static int writeFile(GenState *g, const char *path, off_t size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    while (size > 0) {
+        size_t chunk = size > FILL_BUF_SIZE ? FILL_BUF_SIZE : (size_t)size;
+        ssize_t w = write(fd, g->fill, chunk);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            perror("write");
+            close(fd);
+            return -1;
+        }
+        size -= w;
+    }
+
+    // Deterministic ages so SRU filters select the same files every run
+    struct timespec times[2];
+    time_t age = (time_t)(nextRand(g) % ((uint64_t)g->spec->maxAgeDays * 86400 + 1));
+    times[0] = (struct timespec){ .tv_sec = g->now - age, .tv_nsec = 0 };
+    times[1] = times[0];
+    futimens(fd, times);
+
+    close(fd);
+    return 0;
+}
+
+static void remember(GenState *g, const char *path) {
+    int slot = g->poolCount < LINK_POOL ? g->poolCount++ : (int)(nextRand(g) % LINK_POOL);
+    snprintf(g->pool[slot], PATH_MAX, "%s", path);
+}
+
+static int genDir(GenState *g, const char *dir, int level) {
+    char path[PATH_MAX];
+    char name[NAME_MAX + 1];
+
+    if (mkdir(dir, 0755) != 0) {
+        perror(dir);
+        return -1;
+    }
+    g->stats->dirs++;
+
+    for (int i = 0; i < g->spec->filesPerDir; i++) {
+        int roll = (int)(nextRand(g) % 100);
+        makeName(g, name, sizeof(name), 'f');
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+        if (g->poolCount > 0 && roll < g->spec->hardlinkPct) {
+            const char *target = g->pool[nextRand(g) % g->poolCount];
+            if (link(target, path) == 0) {
+                g->stats->hardlinks++;
+                continue;
+            }
+        } else if (g->poolCount > 0 && roll < g->spec->hardlinkPct + g->spec->symlinkPct) {
+            const char *target = g->pool[nextRand(g) % g->poolCount];
+            if (symlink(target, path) == 0) {
+                g->stats->symlinks++;
+                continue;
+            }
+        }
+
+        off_t size = pickSize(g);
+        if (writeFile(g, path, size) != 0) return -1;
+        g->stats->files++;
+        g->stats->bytes += size;
+        remember(g, path);
+    }
+
+    if (level >= g->spec->depth) return 0;
+
+    for (int i = 0; i < g->spec->fanout; i++) {
+        makeName(g, name, sizeof(name), 'd');
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        if (genDir(g, path, level + 1) != 0) return -1;
+    }
+    return 0;
+}
+
+void defaultTreeSpec(TreeSpec *spec) {
+    memset(spec, 0, sizeof(*spec));
+    spec->seed = 42;
+    spec->depth = 3;
+    spec->fanout = 4;
+    spec->filesPerDir = 50;
+    spec->sizeDist = SIZE_SKEWED;
+    spec->sizeMean = 8192;
+    spec->longNames = 0;
+    spec->hardlinkPct = 5;
+    spec->symlinkPct = 5;
+    spec->maxAgeDays = 365;
+}
+
+int generateTree(const char *root, const TreeSpec *spec, TreeStats *stats) {
+    GenState *g = calloc(1, sizeof(GenState));
+    if (!g) return -1;
+
+    memset(stats, 0, sizeof(*stats));
+    g->spec = spec;
+    g->stats = stats;
+    g->rng = spec->seed ? spec->seed : 1;
+    g->now = time(NULL);
+
+    for (int i = 0; i < FILL_BUF_SIZE; i++)
+        g->fill[i] = (char)nextRand(g);
+
+    // Absolute root so symlink targets resolve from anywhere
+    char absRoot[PATH_MAX];
+    if (root[0] != '/') {
+        char cwd[PATH_MAX];
+        if (!getcwd(cwd, sizeof(cwd))) {
+            free(g);
+            return -1;
+        }
+        if (snprintf(absRoot, sizeof(absRoot), "%s/%s", cwd, root) >= (int)sizeof(absRoot)) {
+            free(g);
+            return -1;
+        }
+    } else {
+        snprintf(absRoot, sizeof(absRoot), "%s", root);
+    }
+
+    int rc = genDir(g, absRoot, 0);
+    free(g);
+    return rc;
+}
@@ -0,0 +1,44 @@
+#ifndef GENTREE_H
+#define GENTREE_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+// ===========================================================
+// SYNTHETIC TREE GENERATOR (gentree.c)
+// ===========================================================
+// Same seed + same options => same tree (names, sizes, mtimes, links).
+
+typedef enum {
+    SIZE_FIXED,      // every file is sizeMean bytes
+    SIZE_UNIFORM,    // uniform in [0, 2 * sizeMean]
+    SIZE_SKEWED      // mostly tiny files with a long tail (~ exponential)
+} SizeDist;
+
+typedef struct TreeSpec {
+    uint64_t seed;
+    int depth;            // directory levels below the root
+    int fanout;           // subdirectories per directory
+    int filesPerDir;      // regular files per directory (root included)
+    SizeDist sizeDist;
+    off_t sizeMean;
+    int longNames;        // 1 = ~200 character file names
+    int hardlinkPct;      // % of extra entries that are hardlinks to earlier files
+    int symlinkPct;       // % of extra entries that are symlinks to earlier files
+    int maxAgeDays;       // mtimes spread over [now - maxAgeDays, now]
+} TreeSpec;
+
+typedef struct TreeStats {
+    long dirs;
+    long files;           // regular files (not counting extra links)
+    long hardlinks;
+    long symlinks;
+    long long bytes;      // apparent bytes of regular files
+} TreeStats;
+
+void defaultTreeSpec(TreeSpec *spec);
+
+// Create the tree under 'root' (must not exist). Returns 0 on success.
+int generateTree(const char *root, const TreeSpec *spec, TreeStats *stats);
+
+#endif
@@ -0,0 +1,122 @@
+// crc32c.c
+// CRC32C (Castagnoli) for verified copies. Uses the SSE4.2 crc32
+// instruction when the CPU has it (checked once at run time, so the
+// binary still runs on older machines) and slicing-by-8 tables otherwise.
+#include "dir_manage.h"
+
+#define CRC32C_POLY 0x82F63B78u     // reflected Castagnoli polynomial
+
+static uint32_t crcTable[8][256];
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+static int useHardware = 0;
+
+// ===============================================================
+// SOFTWARE (SLICING-BY-8)
+// ===============================================================
+static void initTables(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crcTable[0][i] = c;
+    }
+    for (int t = 1; t < 8; t++)
+        for (int i = 0; i < 256; i++)
+            crcTable[t][i] = (crcTable[t - 1][i] >> 8) ^ crcTable[0][crcTable[t - 1][i] & 0xFF];
+}
+
+static uint32_t crcSoftware(uint32_t crc, const unsigned char *p, size_t len) {
+    while (len && ((uintptr_t)p & 7)) {
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *p++) & 0xFF];
+        len--;
+    }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        v ^= crc;       // little endian: low 4 bytes take the running crc
+        crc = crcTable[7][v & 0xFF] ^ crcTable[6][(v >> 8) & 0xFF] ^
+              crcTable[5][(v >> 16) & 0xFF] ^ crcTable[4][(v >> 24) & 0xFF] ^
+              crcTable[3][(v >> 32) & 0xFF] ^ crcTable[2][(v >> 40) & 0xFF] ^
+              crcTable[1][(v >> 48) & 0xFF] ^ crcTable[0][v >> 56];
+        p += 8;
+        len -= 8;
+    }
+#endif
+    while (len--)
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+// ===============================================================
+// HARDWARE (SSE4.2)
+// ===============================================================
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <nmmintrin.h>
+
+__attribute__((target("sse4.2")))
+static uint32_t crcHardware(uint32_t crc, const unsigned char *p, size_t len) {
+    while (len && ((uintptr_t)p & 7)) {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+#ifdef __x86_64__
+    uint64_t c64 = crc;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c64 = _mm_crc32_u64(c64, v);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)c64;
+#endif
+    while (len >= 4) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        crc = _mm_crc32_u32(crc, v);
+        p += 4;
+        len -= 4;
+    }
+    while (len--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+
+static int detectHardware(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+}
+#else
+static uint32_t crcHardware(uint32_t crc, const unsigned char *p, size_t len) {
+    return crcSoftware(crc, p, len);
+}
+
+static int detectHardware(void) {
+    return 0;
+}
+#endif
+
+static void crcInit(void) {
+    initTables();
+    useHardware = detectHardware();
+}
+
+// ===============================================================
+// PUBLIC API
+// ===============================================================
+
+// Running CRC32C: start with crc = 0 and feed the data in order.
+// crc32cUpdate(0, "123456789", 9) == 0xE3069283.
+uint32_t crc32cUpdate(uint32_t crc, const void *buf, size_t len) {
+    pthread_once(&crcOnce, crcInit);
+
+    crc = ~crc;
+    crc = useHardware ? crcHardware(crc, buf, len) : crcSoftware(crc, buf, len);
+    return ~crc;
+}
+
+const char *crc32cImplementation(void) {
+    pthread_once(&crcOnce, crcInit);
+    return useHardware ? "sse4.2" : "software";
+}
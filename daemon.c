@@ -0,0 +1,1104 @@
+// daemon.c
+// Daemon mode: scan one or more roots once, keep the trees in memory and
+// answer queries from local clients over a Unix domain socket.
+//
+//   dir_manage serve [--socket PATH] [--workers N] [--refresh SECS] ROOT...
+//   dir_manage query [--socket PATH] REQUEST...
+//
+// Protocol: one request per line, same word syntax as batch files.
+//   list DIR [--sort name|size|date] [--offset N] [--limit N]
+//   search DIR PATTERN [--offset N] [--limit N]
+//   du PATH
+//   report DIR [--offset N] [--limit N]
+//   cleanup DIR [--min-size BYTES] [--min-age DAYS] [--limit N]
+//   rescan [ROOT]
+//   stats
+// A response is zero or more JSON lines followed by exactly one status
+// line starting with {"status":. Answers hold at most --limit entries
+// (default DAEMON_DEFAULT_LIMIT, at most DAEMON_MAX_LIMIT); larger
+// results are fetched in pages with --offset. A connection may carry any
+// number of requests and is closed after DAEMON_IDLE_SECS without one. Answers come from memory until the next rescan, so results
+// can lag behind the filesystem by up to the refresh interval. When every
+// queue slot is taken, a new connection gets a "server busy" status line
+// and is closed.
+#include "dir_manage.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define DAEMON_DEFAULT_WORKERS 4
+#define DAEMON_MAX_WORKERS     64
+#define DAEMON_MAX_ROOTS       16
+#define CONN_QUEUE_SIZE        64
+#define NAME_BLOCK_SIZE        65536
+#define MAX_REQUEST_ARGS       16
+#define MAX_REQUEST_LINE       (2 * PATH_MAX)
+#define DAEMON_DEFAULT_LIMIT   1000
+#define DAEMON_MAX_LIMIT       100000
+#define DAEMON_IDLE_SECS       30
+
+// ===============================================================
+// IN-MEMORY TREE
+// ===============================================================
+// Nodes are stored breadth first, so the children of a directory are
+// one contiguous, name-sorted run and every parent comes before its
+// children. Lookups are a binary search per path component.
+typedef struct TreeNode {
+    const char *name;       // root node: the full root path
+    int parent;             // -1 for the root
+    int childStart;         // directories: children are [childStart, childStart + childCount)
+    int childCount;
+    unsigned char isDir;
+    unsigned char duplicate;    // this file's data was counted already (link or hardlink)
+    unsigned char viaLink;      // reached through a symlink (describes the target)
+    unsigned char primary;      // first real path to the file: cleanup may suggest it
+    int owner;              // index into MemTree.users / groups
+    int group;
+    time_t mtime;
+    long long bytes;        // files: st_size; directories: subtree total
+    long long allocated;    // files: st_blocks * 512; directories: subtree total
+    long long files;        // directories: regular files below
+    long long dirs;         // directories: subdirectories below
+} TreeNode;
+
+typedef struct NameBlock {
+    struct NameBlock *next;
+    size_t used;
+    char data[NAME_BLOCK_SIZE];
+} NameBlock;
+
+typedef struct IdName {
+    unsigned id;
+    char name[64];
+} IdName;
+
+typedef struct MemTree {
+    TreeNode *nodes;
+    int count;
+    int cap;
+    NameBlock *names;       // names never move once stored
+    IdName *users;
+    int userCount;
+    IdName *groups;
+    int groupCount;
+    time_t scannedAt;
+    double scanMs;
+} MemTree;
+
+static void freeTree(MemTree *t) {
+    if (!t) return;
+    while (t->names) {
+        NameBlock *next = t->names->next;
+        free(t->names);
+        t->names = next;
+    }
+    free(t->nodes);
+    free(t->users);
+    free(t->groups);
+    free(t);
+}
+
+static const char *storeName(MemTree *t, const char *name) {
+    size_t len = strlen(name) + 1;
+    if (len > NAME_BLOCK_SIZE) return NULL;
+
+    if (!t->names || t->names->used + len > NAME_BLOCK_SIZE) {
+        NameBlock *b = malloc(sizeof(NameBlock));
+        if (!b) return NULL;
+        b->next = t->names;
+        b->used = 0;
+        t->names = b;
+    }
+    char *p = t->names->data + t->names->used;
+    memcpy(p, name, len);
+    t->names->used += len;
+    return p;
+}
+
+static int addNode(MemTree *t, const char *name, int parent, const struct stat *st) {
+    if (t->count == t->cap) {
+        int newCap = t->cap ? t->cap * 2 : 1024;
+        TreeNode *grown = realloc(t->nodes, sizeof(TreeNode) * newCap);
+        if (!grown) return -1;
+        t->nodes = grown;
+        t->cap = newCap;
+    }
+
+    TreeNode *n = &t->nodes[t->count];
+    memset(n, 0, sizeof(*n));
+    n->name = storeName(t, name);
+    if (!n->name) return -1;
+    n->parent = parent;
+    n->isDir = S_ISDIR(st->st_mode);
+    n->owner = (int)st->st_uid;     // raw id until resolveNames() runs
+    n->group = (int)st->st_gid;
+    n->mtime = st->st_mtime;
+    if (!n->isDir) {
+        n->bytes = st->st_size;
+        n->allocated = (long long)st->st_blocks * 512;
+    }
+    return t->count++;
+}
+
+static int compareNodeName(const void *a, const void *b) {
+    return strcmp(((const TreeNode *)a)->name, ((const TreeNode *)b)->name);
+}
+
+// Map a uid/gid to an index in a small name table (thread-safe lookups:
+// several roots may be rescanned at the same time).
+static int idIndex(IdName **table, int *count, unsigned id, int isGroup) {
+    for (int i = *count - 1; i >= 0; i--)
+        if ((*table)[i].id == id) return i;
+
+    IdName *grown = realloc(*table, sizeof(IdName) * (*count + 1));
+    if (!grown) return -1;
+    *table = grown;
+
+    IdName *e = &grown[*count];
+    char buf[4096];
+    e->id = id;
+    snprintf(e->name, sizeof(e->name), "unknown");
+
+    METRIC_START(t);
+    if (isGroup) {
+        struct group gr, *res = NULL;
+        if (getgrgid_r((gid_t)id, &gr, buf, sizeof(buf), &res) == 0 && res)
+            snprintf(e->name, sizeof(e->name), "%s", res->gr_name);
+    } else {
+        struct passwd pw, *res = NULL;
+        if (getpwuid_r((uid_t)id, &pw, buf, sizeof(buf), &res) == 0 && res)
+            snprintf(e->name, sizeof(e->name), "%s", res->pw_name);
+    }
+    METRIC_STOP(MET_NAME_LOOKUP, t);
+
+    return (*count)++;
+}
+
+static int resolveNames(MemTree *t) {
+    for (int i = 0; i < t->count; i++) {
+        TreeNode *n = &t->nodes[i];
+        n->owner = idIndex(&t->users, &t->userCount, (unsigned)n->owner, 0);
+        n->group = idIndex(&t->groups, &t->groupCount, (unsigned)n->group, 1);
+        if (n->owner < 0 || n->group < 0) return -1;
+    }
+    return 0;
+}
+
+// Append "/name" to path (no doubled slash after "/"). Returns new length or -1.
+static int appendComponent(char *path, int len, size_t size, const char *name) {
+    int n = snprintf(path + len, size - len, "%s%s",
+                     (len > 0 && path[len - 1] == '/') ? "" : "/", name);
+    if (n < 0 || (size_t)(len + n) >= size) return -1;
+    return len + n;
+}
+
+static int nodePath(const MemTree *t, int idx, char *path, size_t size) {
+    int chain[PATH_MAX / 2];
+    int depth = 0;
+
+    while (idx > 0 && depth < (int)(sizeof(chain) / sizeof(chain[0]))) {
+        chain[depth++] = idx;
+        idx = t->nodes[idx].parent;
+    }
+
+    int len = snprintf(path, size, "%s", t->nodes[0].name);
+    while (depth > 0 && len >= 0)
+        len = appendComponent(path, len, size, t->nodes[chain[--depth]].name);
+    return len;
+}
+
+// Breadth-first scan of 'root' honouring the traversal policy.
+static MemTree *buildTree(const char *root) {
+    MemTree *t = calloc(1, sizeof(MemTree));
+    TraversalState ts;
+    struct stat st;
+    char path[PATH_MAX];
+    unsigned long long start = metricsNow();
+
+    if (!t) return NULL;
+    if (metStat(root, &st) != 0 || traversalStart(&ts, root) != 0) {
+        freeTree(t);
+        return NULL;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        traversalEnd(&ts);
+        freeTree(t);
+        errno = ENOTDIR;
+        return NULL;
+    }
+
+    if (addNode(t, root, -1, &st) < 0) goto fail;
+
+    for (int d = 0; d < t->count; d++) {
+        DirListing dl;
+
+        if (!t->nodes[d].isDir) continue;
+        if (nodePath(t, d, path, sizeof(path)) < 0) continue;
+        if (readDirListing(path, traversalPolicy.followSymlinks, &dl) != 0) continue;
+
+        int first = t->count;
+        for (int i = 0; i < dl.count; i++) {
+            if (dl.err[i] != 0) continue;
+
+            int linked = t->nodes[d].viaLink || dl.isLink[i];
+
+            if (S_ISDIR(dl.st[i].st_mode)) {
+                if (!traversalEnterDir(&ts, &dl.st[i], linked)) continue;
+            } else if (!S_ISREG(dl.st[i].st_mode)) {
+                continue;
+            }
+
+            int idx = addNode(t, dl.names[i], d, &dl.st[i]);
+            if (idx < 0) {
+                freeDirListing(&dl);
+                goto fail;
+            }
+            t->nodes[idx].viaLink = linked;
+            if (!t->nodes[idx].isDir) {
+                t->nodes[idx].duplicate = !traversalFirstVisit(&ts, &dl.st[i], linked);
+                t->nodes[idx].primary = traversalPrimaryPath(&ts, &dl.st[i], linked);
+            }
+        }
+        freeDirListing(&dl);
+
+        // None of the new nodes has children yet, so they can be reordered
+        t->nodes[d].childStart = first;
+        t->nodes[d].childCount = t->count - first;
+        qsort(&t->nodes[first], t->count - first, sizeof(TreeNode), compareNodeName);
+    }
+
+    // Children always follow their parent: one reverse pass rolls up totals
+    for (int i = t->count - 1; i > 0; i--) {
+        TreeNode *n = &t->nodes[i], *p = &t->nodes[n->parent];
+        if (n->isDir) {
+            p->bytes += n->bytes;
+            p->allocated += n->allocated;
+            p->files += n->files;
+            p->dirs += n->dirs + !n->viaLink;     // linked copies are not extra directories
+        } else if (!n->duplicate) {
+            p->bytes += n->bytes;
+            p->allocated += n->allocated;
+            p->files++;
+        }
+    }
+
+    if (resolveNames(t) != 0) goto fail;
+
+    traversalEnd(&ts);
+    t->scannedAt = time(NULL);
+    t->scanMs = (metricsNow() - start) / 1e6;
+    return t;
+
+fail:
+    traversalEnd(&ts);
+    freeTree(t);
+    errno = ENOMEM;
+    return NULL;
+}
+
+// Find the node for 'rel' (path below the root, '/'-separated). -1 if absent.
+static int findNode(const MemTree *t, const char *rel) {
+    int cur = 0;
+
+    while (*rel) {
+        while (*rel == '/') rel++;
+        if (!*rel) break;
+
+        size_t len = strcspn(rel, "/");
+        const TreeNode *dir = &t->nodes[cur];
+        if (!dir->isDir) return -1;
+
+        int lo = dir->childStart, hi = dir->childStart + dir->childCount;
+        cur = -1;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            int c = strncmp(t->nodes[mid].name, rel, len);
+            if (c == 0 && t->nodes[mid].name[len] != '\0') c = 1;
+            if (c == 0) { cur = mid; break; }
+            if (c < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        if (cur < 0) return -1;
+        rel += len;
+    }
+    return cur;
+}
+
+// ===============================================================
+// SERVED ROOTS
+// ===============================================================
+typedef struct ServedRoot {
+    char path[PATH_MAX];
+    pthread_rwlock_t lock;          // readers: requests; writer: tree swap
+    pthread_mutex_t rescanLock;     // one rescan of this root at a time
+    MemTree *tree;
+} ServedRoot;
+
+static ServedRoot roots[DAEMON_MAX_ROOTS];
+static int rootCount = 0;
+static char daemonCwd[PATH_MAX];
+static volatile sig_atomic_t stopping = 0;
+static unsigned long long requestsServed = 0;
+
+static int rescanRoot(ServedRoot *r) {
+    pthread_mutex_lock(&r->rescanLock);
+    MemTree *fresh = buildTree(r->path);
+    if (!fresh) {
+        perror(r->path);
+        pthread_mutex_unlock(&r->rescanLock);
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&r->lock);
+    MemTree *old = r->tree;
+    r->tree = fresh;
+    pthread_rwlock_unlock(&r->lock);
+    pthread_mutex_unlock(&r->rescanLock);
+
+    freeTree(old);
+    return 0;
+}
+
+// Lexically normalise 'in' to an absolute path (relative to the
+// daemon's cwd) without touching the filesystem.
+static int normalizePath(const char *in, char *out, size_t size) {
+    char tmp[PATH_MAX];
+    int len = 0;
+
+    if (in[0] == '/') snprintf(tmp, sizeof(tmp), "%s", in);
+    else if (snprintf(tmp, sizeof(tmp), "%s/%s", daemonCwd, in) >= (int)sizeof(tmp)) return -1;
+
+    out[0] = '\0';
+    for (char *save = NULL, *c = strtok_r(tmp, "/", &save); c; c = strtok_r(NULL, "/", &save)) {
+        if (strcmp(c, ".") == 0) continue;
+        if (strcmp(c, "..") == 0) {
+            while (len > 0 && out[len - 1] != '/') len--;
+            if (len > 0) len--;
+            out[len] = '\0';
+            continue;
+        }
+        int n = snprintf(out + len, size - len, "/%s", c);
+        if (n < 0 || (size_t)(len + n) >= size) return -1;
+        len += n;
+    }
+    if (len == 0) snprintf(out, size, "/");
+    return 0;
+}
+
+// Longest served root containing 'path'; *rel points at the rest.
+static ServedRoot *findRoot(const char *path, const char **rel) {
+    ServedRoot *best = NULL;
+    size_t bestLen = 0;
+
+    for (int i = 0; i < rootCount; i++) {
+        size_t len = strlen(roots[i].path);
+        if (len == 1) len = 0;      // "/" matches everything
+        if (strncmp(path, roots[i].path, len) == 0 &&
+            (path[len] == '/' || path[len] == '\0') &&
+            (!best || len >= bestLen)) {
+            best = &roots[i];
+            bestLen = len;
+        }
+    }
+    if (best) *rel = path + bestLen;
+    return best;
+}
+
+// ===============================================================
+// REQUEST HANDLING
+// ===============================================================
+typedef struct Request {
+    const char *cmd;
+    const char *pos[2];
+    int npos;
+    int sortChoice;         // 1 = name, 2 = size, 3 = date
+    size_t offset;
+    size_t limit;
+    long long minSize;
+    int minAge;
+} Request;
+
+static int parseRequest(int argc, char *argv[], Request *rq) {
+    memset(rq, 0, sizeof(*rq));
+    rq->cmd = argv[0];
+    rq->sortChoice = 1;
+    rq->limit = DAEMON_DEFAULT_LIMIT;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(a, "--sort") == 0 && val) {
+            rq->sortChoice = strcmp(val, "size") == 0 ? 2 : strcmp(val, "date") == 0 ? 3 : 1;
+            i++;
+        } else if (strcmp(a, "--offset") == 0 && val) {
+            rq->offset = strtoul(val, NULL, 10); i++;
+        } else if (strcmp(a, "--limit") == 0 && val) {
+            // Bounds the reply, which is buffered in full before sending
+            rq->limit = strtoul(val, NULL, 10); i++;
+            if (rq->limit > DAEMON_MAX_LIMIT) rq->limit = DAEMON_MAX_LIMIT;
+        } else if (strcmp(a, "--min-size") == 0 && val) {
+            rq->minSize = strtoll(val, NULL, 10); i++;
+        } else if (strcmp(a, "--min-age") == 0 && val) {
+            rq->minAge = atoi(val); i++;
+        } else if (a[0] == '-' && a[1] != '\0') {
+            return -1;
+        } else if (rq->npos < 2) {
+            rq->pos[rq->npos++] = a;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void writeStatusError(FILE *out, const char *op, const char *error) {
+    fprintf(out, "{\"status\":\"error\",\"op\":");
+    writeJSONString(out, op);
+    fprintf(out, ",\"error\":");
+    writeJSONString(out, error);
+    fprintf(out, "}\n");
+}
+
+static void writeFileFields(FILE *out, const MemTree *t, const TreeNode *n) {
+    fprintf(out, ",\"size\":%lld,\"allocated\":%lld,\"owner\":", n->bytes, n->allocated);
+    writeJSONString(out, t->users[n->owner].name);
+    fprintf(out, ",\"group\":");
+    writeJSONString(out, t->groups[n->group].name);
+    fprintf(out, ",\"mtime\":%ld", (long)n->mtime);
+}
+
+static int nodePtrBySize(const void *a, const void *b) {
+    const TreeNode *n1 = *(const TreeNode * const *)a, *n2 = *(const TreeNode * const *)b;
+    if (n1->bytes != n2->bytes) return n1->bytes < n2->bytes ? -1 : 1;
+    return strcmp(n1->name, n2->name);
+}
+
+static int nodePtrByDate(const void *a, const void *b) {
+    const TreeNode *n1 = *(const TreeNode * const *)a, *n2 = *(const TreeNode * const *)b;
+    if (n1->mtime != n2->mtime) return n1->mtime < n2->mtime ? -1 : 1;
+    return strcmp(n1->name, n2->name);
+}
+
+// Regular files directly in a directory, same order and paging as 'list'
+static void handleList(FILE *out, const MemTree *t, int idx, const Request *rq) {
+    const TreeNode *dir = &t->nodes[idx];
+    const TreeNode **files = malloc(sizeof(TreeNode *) * (dir->childCount ? dir->childCount : 1));
+    size_t total = 0, emitted = 0;
+
+    if (!files) {
+        writeStatusError(out, "list", "out of memory");
+        return;
+    }
+    for (int i = dir->childStart; i < dir->childStart + dir->childCount; i++)
+        if (!t->nodes[i].isDir) files[total++] = &t->nodes[i];
+
+    // Children are stored name-sorted already
+    if (rq->sortChoice == 2) qsort(files, total, sizeof(files[0]), nodePtrBySize);
+    if (rq->sortChoice == 3) qsort(files, total, sizeof(files[0]), nodePtrByDate);
+
+    for (size_t i = rq->offset; i < total && emitted < rq->limit; i++, emitted++) {
+        fprintf(out, "{\"op\":\"list\",\"name\":");
+        writeJSONString(out, files[i]->name);
+        writeFileFields(out, t, files[i]);
+        fprintf(out, "}\n");
+    }
+    free(files);
+
+    fprintf(out, "{\"status\":\"ok\",\"op\":\"list\",\"count\":%zu,\"total\":%zu}\n", emitted, total);
+}
+
+typedef struct FileVisit {
+    FILE *out;
+    const Request *rq;
+    size_t skipped;         // matches before --offset
+    size_t emitted;
+    int isReport;
+} FileVisit;
+
+// Depth-first over files below 'dir' in name order; path holds the
+// directory's path on entry and is restored on return.
+static int visitFiles(const MemTree *t, int dir, char *path, int len, FileVisit *v) {
+    const TreeNode *d = &t->nodes[dir];
+
+    for (int i = d->childStart; i < d->childStart + d->childCount; i++) {
+        const TreeNode *n = &t->nodes[i];
+        int sub = appendComponent(path, len, PATH_MAX, n->name);
+        if (sub < 0) continue;
+
+        if (n->isDir) {
+            if (visitFiles(t, i, path, sub, v) != 0) return -1;
+        } else if (v->isReport) {
+            // Hardlinks count once so totals match real usage
+            if (n->duplicate) continue;
+            if (v->skipped < v->rq->offset) { v->skipped++; continue; }
+            if (v->emitted >= v->rq->limit) return -1;
+            fprintf(v->out, "{\"op\":\"report\",\"path\":");
+            writeJSONString(v->out, path);
+            writeFileFields(v->out, t, n);
+            fprintf(v->out, "}\n");
+            v->emitted++;
+        } else if (strstr(n->name, v->rq->pos[1]) != NULL) {
+            if (v->skipped < v->rq->offset) { v->skipped++; continue; }
+            if (v->emitted >= v->rq->limit) return -1;
+            fprintf(v->out, "{\"op\":\"search\",\"match\":");
+            writeJSONString(v->out, path);
+            fprintf(v->out, "}\n");
+            v->emitted++;
+        }
+        path[len] = '\0';
+    }
+    return 0;
+}
+
+static void handleWalk(FILE *out, const MemTree *t, int idx, const Request *rq, int isReport) {
+    char path[PATH_MAX];
+    FileVisit v = { out, rq, 0, 0, isReport };
+    const TreeNode *n = &t->nodes[idx];
+
+    int len = nodePath(t, idx, path, sizeof(path));
+    if (len < 0) {
+        writeStatusError(out, rq->cmd, "path too long");
+        return;
+    }
+    visitFiles(t, idx, path, len, &v);
+
+    if (isReport)
+        fprintf(out, "{\"status\":\"ok\",\"op\":\"report\",\"count\":%zu,\"files\":%lld,"
+                     "\"bytes\":%lld,\"allocated\":%lld}\n", v.emitted, n->files, n->bytes, n->allocated);
+    else
+        fprintf(out, "{\"status\":\"ok\",\"op\":\"search\",\"count\":%zu}\n", v.emitted);
+}
+
+// Hard-linked data is attributed to the first path the scan reached,
+// so the root total matches real usage and subtrees never double count
+static void handleDu(FILE *out, const MemTree *t, int idx, const char *path) {
+    const TreeNode *n = &t->nodes[idx];
+    fprintf(out, "{\"status\":\"ok\",\"op\":\"du\",\"path\":");
+    writeJSONString(out, path);
+    fprintf(out, ",\"files\":%lld,\"dirs\":%lld,\"bytes\":%lld,\"allocated\":%lld}\n",
+            n->isDir ? n->files : 1, n->dirs, n->bytes, n->allocated);
+}
+
+// Same criteria as the SRU filter: top-level files above a size and age
+static void handleCleanup(FILE *out, const MemTree *t, int idx, const Request *rq) {
+    const TreeNode *dir = &t->nodes[idx];
+    char path[PATH_MAX];
+    time_t now = time(NULL);
+    size_t count = 0;
+
+    int len = nodePath(t, idx, path, sizeof(path));
+    for (int i = dir->childStart; len >= 0 && i < dir->childStart + dir->childCount &&
+                                  count < rq->limit; i++) {
+        const TreeNode *n = &t->nodes[i];
+        // Removing a symlink frees nothing; suggest the real file
+        if (n->isDir || !n->primary) continue;
+
+        double ageInDays = difftime(now, n->mtime) / (60 * 60 * 24);
+        if (n->bytes > rq->minSize && ageInDays > rq->minAge &&
+            appendComponent(path, len, sizeof(path), n->name) >= 0) {
+            fprintf(out, "{\"op\":\"cleanup\",\"suggest\":");
+            writeJSONString(out, path);
+            fprintf(out, ",\"size\":%lld,\"age_days\":%.1f}\n", n->bytes, ageInDays);
+            path[len] = '\0';
+            count++;
+        }
+    }
+    fprintf(out, "{\"status\":\"ok\",\"op\":\"cleanup\",\"count\":%zu}\n", count);
+}
+
+static void handleStats(FILE *out, int workers) {
+    for (int i = 0; i < rootCount; i++) {
+        pthread_rwlock_rdlock(&roots[i].lock);
+        const MemTree *t = roots[i].tree;
+        fprintf(out, "{\"op\":\"stats\",\"root\":");
+        writeJSONString(out, roots[i].path);
+        fprintf(out, ",\"nodes\":%d,\"files\":%lld,\"bytes\":%lld,\"scanned_at\":%ld,\"scan_ms\":%.3f}\n",
+                t->count, t->nodes[0].files, t->nodes[0].bytes, (long)t->scannedAt, t->scanMs);
+        pthread_rwlock_unlock(&roots[i].lock);
+    }
+    fprintf(out, "{\"status\":\"ok\",\"op\":\"stats\",\"roots\":%d,\"workers\":%d,\"requests\":%llu}\n",
+            rootCount, workers, __atomic_load_n(&requestsServed, __ATOMIC_RELAXED));
+}
+
+static void handleRescan(FILE *out, const Request *rq) {
+    char norm[PATH_MAX];
+    const char *rel;
+    int done = 0, failed = 0;
+    ServedRoot *only = NULL;
+
+    if (rq->npos == 1) {
+        if (normalizePath(rq->pos[0], norm, sizeof(norm)) != 0 ||
+            !(only = findRoot(norm, &rel)) || *rel != '\0') {
+            writeStatusError(out, "rescan", "not a served root");
+            return;
+        }
+    }
+
+    for (int i = 0; i < rootCount; i++) {
+        if (only && only != &roots[i]) continue;
+        if (rescanRoot(&roots[i]) == 0) done++;
+        else failed++;
+    }
+
+    if (failed) writeStatusError(out, "rescan", "scan failed");
+    else fprintf(out, "{\"status\":\"ok\",\"op\":\"rescan\",\"roots\":%d}\n", done);
+}
+
+static void handleRequest(char *line, FILE *out, int workers) {
+    char *argv[MAX_REQUEST_ARGS];
+    Request rq;
+    int argc = tokenizeLine(line, argv, MAX_REQUEST_ARGS);
+
+    if (argc == 0) return;
+    __atomic_add_fetch(&requestsServed, 1, __ATOMIC_RELAXED);
+
+    if (parseRequest(argc, argv, &rq) != 0) {
+        writeStatusError(out, argv[0], "invalid arguments");
+        return;
+    }
+    if (strcmp(rq.cmd, "stats") == 0) {
+        handleStats(out, workers);
+        return;
+    }
+    if (strcmp(rq.cmd, "rescan") == 0) {
+        handleRescan(out, &rq);
+        return;
+    }
+
+    int isList = strcmp(rq.cmd, "list") == 0, isSearch = strcmp(rq.cmd, "search") == 0;
+    int isDu = strcmp(rq.cmd, "du") == 0, isReport = strcmp(rq.cmd, "report") == 0;
+    int isCleanup = strcmp(rq.cmd, "cleanup") == 0;
+
+    if (!isList && !isSearch && !isDu && !isReport && !isCleanup) {
+        writeStatusError(out, rq.cmd, "unknown command");
+        return;
+    }
+    if (rq.npos != (isSearch ? 2 : 1)) {
+        writeStatusError(out, rq.cmd, "wrong number of arguments");
+        return;
+    }
+
+    char path[PATH_MAX];
+    const char *rel;
+    ServedRoot *r;
+    if (normalizePath(rq.pos[0], path, sizeof(path)) != 0 || !(r = findRoot(path, &rel))) {
+        writeStatusError(out, rq.cmd, "path is not under a served root");
+        return;
+    }
+
+    pthread_rwlock_rdlock(&r->lock);
+    const MemTree *t = r->tree;
+    int idx = findNode(t, rel);
+
+    if (idx < 0) {
+        writeStatusError(out, rq.cmd, strerror(ENOENT));
+    } else if (!isDu && !t->nodes[idx].isDir) {
+        writeStatusError(out, rq.cmd, strerror(ENOTDIR));
+    } else if (isList) {
+        handleList(out, t, idx, &rq);
+    } else if (isSearch || isReport) {
+        handleWalk(out, t, idx, &rq, isReport);
+    } else if (isDu) {
+        handleDu(out, t, idx, path);
+    } else {
+        handleCleanup(out, t, idx, &rq);
+    }
+    pthread_rwlock_unlock(&r->lock);
+}
+
+// ===============================================================
+// WORKER POOL
+// ===============================================================
+// The accept loop hands connections to workers through a bounded ring
+// guarded by two counting semaphores (like the shared-walk queue in
+// batch.c); a mutex serialises the multiple consumers. The accept loop
+// never waits for a slot, so a full queue cannot delay shutdown.
+typedef struct ConnQueue {
+    int fds[CONN_QUEUE_SIZE];
+    int head, tail;
+    sem_t freeSlots;
+    sem_t usedSlots;
+    pthread_mutex_t popLock;
+} ConnQueue;
+
+static ConnQueue connQueue;
+static int workerCount = DAEMON_DEFAULT_WORKERS;
+static int activeFds[DAEMON_MAX_WORKERS];
+static pthread_mutex_t activeLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Queue fd for the workers. Without 'wait', returns -1 if the queue is full.
+static int pushConn(int fd, int wait) {
+    if (wait) {
+        while (sem_wait(&connQueue.freeSlots) != 0 && errno == EINTR)
+            ;
+    } else if (sem_trywait(&connQueue.freeSlots) != 0) {
+        return -1;
+    }
+    connQueue.fds[connQueue.tail] = fd;
+    connQueue.tail = (connQueue.tail + 1) % CONN_QUEUE_SIZE;
+    sem_post(&connQueue.usedSlots);
+    return 0;
+}
+
+static int popConn(void) {
+    while (sem_wait(&connQueue.usedSlots) != 0 && errno == EINTR)
+        ;
+    pthread_mutex_lock(&connQueue.popLock);
+    int fd = connQueue.fds[connQueue.head];
+    connQueue.head = (connQueue.head + 1) % CONN_QUEUE_SIZE;
+    pthread_mutex_unlock(&connQueue.popLock);
+    sem_post(&connQueue.freeSlots);
+    return fd;
+}
+
+// Close connections still waiting for a worker
+static void dropQueuedConns(void) {
+    while (sem_trywait(&connQueue.usedSlots) == 0) {
+        pthread_mutex_lock(&connQueue.popLock);
+        int fd = connQueue.fds[connQueue.head];
+        connQueue.head = (connQueue.head + 1) % CONN_QUEUE_SIZE;
+        pthread_mutex_unlock(&connQueue.popLock);
+        sem_post(&connQueue.freeSlots);
+        if (fd >= 0) close(fd);
+    }
+}
+
+static void rejectBusy(int fd) {
+    static const char busy[] = "{\"status\":\"error\",\"error\":\"server busy\"}\n";
+    send(fd, busy, sizeof(busy) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);    // best effort
+    close(fd);
+}
+
+static void setActiveFd(int worker, int fd) {
+    pthread_mutex_lock(&activeLock);
+    activeFds[worker] = fd;
+    if (fd >= 0 && stopping) shutdown(fd, SHUT_RDWR);
+    pthread_mutex_unlock(&activeLock);
+}
+
+static void serveConnection(int fd) {
+    int outFd = dup(fd);
+    FILE *in = fdopen(fd, "r");
+    FILE *out = outFd >= 0 ? fdopen(outFd, "w") : NULL;
+    char line[MAX_REQUEST_LINE];
+
+    if (!in || !out) {
+        perror("fdopen");
+        if (in) fclose(in); else close(fd);
+        if (out) fclose(out); else if (outFd >= 0) close(outFd);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), in)) {
+        // The answer is formatted in memory while the tree is read locked
+        // and only sent afterwards, so a slow client cannot hold up a rescan
+        char *reply = NULL;
+        size_t replyLen = 0;
+        FILE *mem = open_memstream(&reply, &replyLen);
+        if (!mem) {
+            perror("open_memstream");
+            break;
+        }
+
+        if (!strchr(line, '\n') && !feof(in)) {
+            int c;
+            while ((c = getc(in)) != EOF && c != '\n')
+                ;
+            writeStatusError(mem, "?", "request too long");
+        } else {
+            handleRequest(line, mem, workerCount);
+        }
+
+        int ok = fclose(mem) == 0;
+        ok = ok && fwrite(reply, 1, replyLen, out) == replyLen && fflush(out) == 0;
+        free(reply);
+        if (!ok) break;
+    }
+
+    fclose(out);
+    fclose(in);
+}
+
+static void *workerThread(void *arg) {
+    int id = (int)(intptr_t)arg;
+
+    for (;;) {
+        int fd = popConn();
+        if (fd < 0) break;      // shutdown marker
+        setActiveFd(id, fd);
+        serveConnection(fd);
+        setActiveFd(id, -1);
+    }
+    return NULL;
+}
+
+static void *refreshThread(void *arg) {
+    int secs = (int)(intptr_t)arg;
+
+    while (!stopping) {
+        for (int s = 0; s < secs && !stopping; s++) sleep(1);
+        for (int i = 0; i < rootCount && !stopping; i++) rescanRoot(&roots[i]);
+    }
+    return NULL;
+}
+
+static void onStopSignal(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+// Refuse to steal the socket of a running daemon or clobber a non-socket
+static int openListenSocket(const char *sockPath) {
+    struct sockaddr_un addr;
+    struct stat st;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(sockPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", sockPath);
+        return -1;
+    }
+    strcpy(addr.sun_path, sockPath);
+
+    if (lstat(sockPath, &st) == 0) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        int live = probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (!S_ISSOCK(st.st_mode) || live) {
+            fprintf(stderr, "%s: already in use\n", sockPath);
+            return -1;
+        }
+        unlink(sockPath);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    // Only the owner may connect: answers expose file names and owners
+    mode_t oldMask = umask(077);
+    int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(oldMask);
+
+    if (rc != 0 || listen(fd, CONN_QUEUE_SIZE) != 0) {
+        perror("bind/listen");
+        close(fd);
+        return -1;
+    }
+
+    // accept() wakes up every second to notice a stop signal that
+    // arrived just before it blocked
+    struct timeval tv = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+// ===============================================================
+// PUBLIC ENTRY POINTS
+// ===============================================================
+int runDaemon(int argc, char *argv[]) {
+    const char *sockPath = DAEMON_DEFAULT_SOCKET;
+    int refreshSecs = 0;
+
+    for (; argc > 0 && argv[0][0] == '-'; argc--, argv++) {
+        if (strcmp(argv[0], "--socket") == 0 && argc > 1) {
+            sockPath = *++argv; argc--;
+        } else if (strcmp(argv[0], "--workers") == 0 && argc > 1) {
+            workerCount = atoi(*++argv); argc--;
+        } else if (strcmp(argv[0], "--refresh") == 0 && argc > 1) {
+            refreshSecs = atoi(*++argv); argc--;
+        } else {
+            break;
+        }
+    }
+    if (argc < 1 || argc > DAEMON_MAX_ROOTS || workerCount < 1 || workerCount > DAEMON_MAX_WORKERS) {
+        fprintf(stderr, "usage: dir_manage serve [--socket PATH] [--workers 1-%d] [--refresh SECS] ROOT...\n",
+                DAEMON_MAX_WORKERS);
+        return EXIT_USAGE;
+    }
+    if (!getcwd(daemonCwd, sizeof(daemonCwd))) {
+        perror("getcwd");
+        return EXIT_OP_FAILED;
+    }
+
+    for (int i = 0; i < argc; i++) {
+        ServedRoot *r = &roots[rootCount];
+        if (!realpath(argv[i], r->path)) {
+            perror(argv[i]);
+            return EXIT_OP_FAILED;
+        }
+        pthread_rwlock_init(&r->lock, NULL);
+        pthread_mutex_init(&r->rescanLock, NULL);
+        rootCount++;
+        if (rescanRoot(r) != 0) return EXIT_OP_FAILED;
+        fprintf(stderr, "serving %s: %d entries in %.1f ms\n", r->path, r->tree->count, r->tree->scanMs);
+    }
+
+    int listenFd = openListenSocket(sockPath);
+    if (listenFd < 0) return EXIT_OP_FAILED;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onStopSignal;      // no SA_RESTART: accept() must return
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);          // clients may disconnect mid-answer
+
+    // Only the accept loop takes the stop signals
+    sigset_t stopSet, oldSet;
+    sigemptyset(&stopSet);
+    sigaddset(&stopSet, SIGINT);
+    sigaddset(&stopSet, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSet, &oldSet);
+
+    sem_init(&connQueue.freeSlots, 0, CONN_QUEUE_SIZE);
+    sem_init(&connQueue.usedSlots, 0, 0);
+    pthread_mutex_init(&connQueue.popLock, NULL);
+
+    pthread_t workers[DAEMON_MAX_WORKERS], refresher;
+    int started = 0, rc = 0;
+    for (; started < workerCount; started++) {
+        activeFds[started] = -1;
+        if ((rc = pthread_create(&workers[started], NULL, workerThread, (void *)(intptr_t)started)) != 0)
+            break;
+    }
+    if (started < workerCount) {
+        fprintf(stderr, "pthread_create: %s (running %d of %d workers)\n",
+                strerror(rc), started, workerCount);
+        workerCount = started;
+    }
+    if (refreshSecs > 0 && started > 0 &&
+        (rc = pthread_create(&refresher, NULL, refreshThread, (void *)(intptr_t)refreshSecs)) != 0) {
+        fprintf(stderr, "pthread_create: %s (automatic refresh disabled)\n", strerror(rc));
+        refreshSecs = 0;
+    }
+    if (started == 0) {
+        refreshSecs = 0;
+        stopping = 1;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &oldSet, NULL);
+    if (!stopping) fprintf(stderr, "listening on %s with %d workers\n", sockPath, workerCount);
+
+    while (!stopping) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) perror("accept");
+            continue;
+        }
+        // fgets() on the connection must not wait forever for a request,
+        // nor a reply for a client that stopped reading
+        struct timeval idle = { DAEMON_IDLE_SECS, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &idle, sizeof(idle));
+        if (pushConn(fd, 0) != 0) rejectBusy(fd);
+    }
+
+    // Wake idle workers with shutdown markers and cut off open connections
+    close(listenFd);
+    unlink(sockPath);
+    pthread_mutex_lock(&activeLock);
+    for (int i = 0; i < workerCount; i++)
+        if (activeFds[i] >= 0) shutdown(activeFds[i], SHUT_RDWR);
+    pthread_mutex_unlock(&activeLock);
+
+    // Queued connections are dropped first, so the markers always fit
+    dropQueuedConns();
+    for (int i = 0; i < workerCount; i++) pushConn(-1, 1);
+    for (int i = 0; i < workerCount; i++) pthread_join(workers[i], NULL);
+    if (refreshSecs > 0) pthread_join(refresher, NULL);
+
+    for (int i = 0; i < rootCount; i++) {
+        freeTree(roots[i].tree);
+        pthread_rwlock_destroy(&roots[i].lock);
+        pthread_mutex_destroy(&roots[i].rescanLock);
+    }
+    sem_destroy(&connQueue.freeSlots);
+    sem_destroy(&connQueue.usedSlots);
+    pthread_mutex_destroy(&connQueue.popLock);
+    return started > 0 ? 0 : EXIT_OP_FAILED;
+}
+
+// Send one request and copy the answer to stdout.
+int runDaemonQuery(int argc, char *argv[]) {
+    const char *sockPath = DAEMON_DEFAULT_SOCKET;
+    char line[MAX_REQUEST_LINE], cwd[PATH_MAX];
+    struct sockaddr_un addr;
+    int len = 0;
+
+    if (argc > 1 && strcmp(argv[0], "--socket") == 0) {
+        sockPath = argv[1];
+        argc -= 2; argv += 2;
+    }
+    if (argc < 1 || argc > MAX_REQUEST_ARGS) {
+        fprintf(stderr, "usage: dir_manage query [--socket PATH] list|search|du|report|cleanup|rescan|stats ...\n");
+        return EXIT_USAGE;
+    }
+    if (!getcwd(cwd, sizeof(cwd))) cwd[0] = '\0';
+
+    // The daemon has its own cwd, so the path argument (the first word
+    // after the command that is neither an option nor an option's
+    // value; every request option takes one) is made absolute here
+    int pathDone = 0, isValue = 0;
+    for (int i = 0; i < argc; i++) {
+        const char *w = argv[i];
+        int isPath = 0, n;
+
+        if (i > 0) {
+            if (isValue) isValue = 0;
+            else if (w[0] == '-' && w[1] != '\0') isValue = 1;
+            else if (!pathDone) isPath = pathDone = 1;
+        }
+
+        if (strchr(w, '"')) {
+            fprintf(stderr, "query: arguments may not contain '\"'\n");
+            return EXIT_USAGE;
+        }
+        if (isPath && w[0] != '/' && cwd[0])
+            n = snprintf(line + len, sizeof(line) - len, " \"%s/%s\"", cwd, w);
+        else
+            n = snprintf(line + len, sizeof(line) - len, i ? " \"%s\"" : "%s", w);
+        if (n < 0 || (size_t)(len + n) >= sizeof(line) - 1) {
+            fprintf(stderr, "query: request too long\n");
+            return EXIT_USAGE;
+        }
+        len += n;
+    }
+    line[len++] = '\n';
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sockPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror(sockPath);
+        if (fd >= 0) close(fd);
+        return EXIT_OP_FAILED;
+    }
+    if (write(fd, line, len) != len) {
+        perror("write");
+        close(fd);
+        return EXIT_OP_FAILED;
+    }
+    shutdown(fd, SHUT_WR);
+
+    FILE *in = fdopen(fd, "r");
+    int rc = EXIT_OP_FAILED;
+    char answer[MAX_REQUEST_LINE];
+    while (in && fgets(answer, sizeof(answer), in)) {
+        fputs(answer, stdout);
+        if (strncmp(answer, "{\"status\":", 10) == 0) {
+            if (strncmp(answer, "{\"status\":\"ok\"", 14) == 0) rc = 0;
+            break;
+        }
+    }
+    if (in) fclose(in); else close(fd);
+    fflush(stdout);
+    return rc;
+}
@@ -14,7 +14,7 @@ int generateSuggestions(const char *path, long sizeLimit, int daysOld, Suggestio
     struct dirent *de;
     struct stat st;
     char fullPath[1024];
-    DIR *dr = opendir(path);
+    DIR *dr = metOpendir(path);
 
     if (!dr) {
         perror("Unable to open directory");
@@ -24,14 +24,14 @@ int generateSuggestions(const char *path, long sizeLimit, int daysOld, Suggestio
     int count = 0;
     time_t now = time(NULL);
 
-    while ((de = readdir(dr)) != NULL) {
+    while ((de = metReaddir(dr)) != NULL) {
 
         if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
             continue;
 
         snprintf(fullPath, sizeof(fullPath), "%s/%s", path, de->d_name);
 
-        if (stat(fullPath, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (statForTraversal(fullPath, &st, NULL) == 0 && S_ISREG(st.st_mode)) {
             double ageInDays = difftime(now, st.st_mtime) / (60 * 60 * 24);
 
             if (st.st_size > sizeLimit && ageInDays > daysOld) {
@@ -101,10 +101,11 @@ void deleteBySRUFilter(const char *path) {
     // File to delete
     char *targetFile = suggestions[fileIndex - 1].fullPath;
 
-    // THREAD SAFE DELETE
+    // THREAD SAFE DELETE (rate-limited when throttling is configured)
+    throttleAcquire(1, 0);
     lockFileOps();
 
-    if (remove(targetFile) == 0) {
+    if (metRemove(targetFile) == 0) {
         printf("\nSuccessfully deleted: %s\n", targetFile);
     } else {
         perror("Error deleting file");
@@ -0,0 +1,367 @@
+// devices.c
+// Per-device concurrency. Every st_dev seen by a traversal or copy is
+// classified once (NVMe/SSD/rotational from sysfs, network and memory
+// filesystems from statfs) and gets its own concurrency limits, which
+// are then tuned online from the throughput and latency actually seen.
+//
+// Three independent "lanes" per device:
+//   DEV_LANE_WALK  directory-walker threads working on the device
+//   DEV_LANE_META  io_uring metadata requests in flight (statx, unlink)
+//   DEV_LANE_DATA  copy chunks in flight
+#define _GNU_SOURCE
+#include "dir_manage.h"
+#include <errno.h>
+#include <sys/sysmacros.h>
+#include <sys/vfs.h>
+
+DeviceConfig deviceConfig = { .maxJobs = DEVICE_DEFAULT_JOBS, .tune = 1 };
+
+// statfs f_type values (linux/magic.h is not always installed)
+#define NFS_SUPER_MAGIC     0x6969
+#define SMB_SUPER_MAGIC     0x517B
+#define CIFS_SUPER_MAGIC    0xFF534D42
+#define SMB2_SUPER_MAGIC    0xFE534D42
+#define CEPH_SUPER_MAGIC    0x00C36400
+#define FUSE_SUPER_MAGIC    0x65735546
+#define TMPFS_MAGIC         0x01021994
+#define RAMFS_MAGIC         0x858458F6
+
+#define TUNE_WINDOW_NS      200000000ULL    // re-evaluate every 200 ms
+#define TUNE_MIN_SAMPLES    4
+#define TUNE_TOLERANCE      0.05            // +-5% throughput counts as "same"
+#define MAX_DEVICES         64
+
+typedef struct TuneLane {
+    int limit;
+    int minLimit, maxLimit;
+    int active;                 // gated users (walker threads)
+    int direction;              // +1 probing up, -1 probing down
+    int saturated;              // the limit was reached this window
+    double lastThroughput;      // items per second, previous window
+    double bestLatencyNs;       // lowest per-op latency seen
+    unsigned long long windowStart;
+    unsigned long long windowItems;
+    unsigned long long windowOps;
+    unsigned long long windowLatencyNs;
+    unsigned long long totalItems;
+    unsigned long long firstNs;     // wall-clock span of all observations
+    unsigned long long lastNs;
+    int adjustments;
+} TuneLane;
+
+struct DeviceProfile {
+    dev_t dev;
+    DeviceKind kind;
+    char name[32];
+    pthread_mutex_t lock;
+    pthread_cond_t freed;
+    TuneLane lanes[DEV_NUM_LANES];
+};
+
+static DeviceProfile *devices[MAX_DEVICES];
+static int deviceCount = 0;
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Starting point and bounds per kind and lane: { initial, min, max }.
+// Spinning disks seek between concurrent requests, so they start at one
+// walker; NVMe and network storage need many requests in flight.
+static const int laneDefaults[DEV_NUM_KINDS][DEV_NUM_LANES][3] = {
+    //                 WALK           META            DATA
+    [DEV_UNKNOWN]    = { { 4, 1, 32 }, { 16, 1, 128 }, {  8, 1, 32 } },
+    [DEV_NVME]       = { { 16, 2, 64 }, { 64, 4, 256 }, { 32, 2, 64 } },
+    [DEV_SSD]        = { { 8, 1, 32 }, { 32, 2, 128 }, { 16, 1, 32 } },
+    [DEV_ROTATIONAL] = { { 1, 1, 4 },  {  4, 1, 32 },  {  2, 1, 8 } },
+    [DEV_NETWORK]    = { { 8, 1, 64 }, { 16, 1, 128 }, {  8, 1, 32 } },
+    [DEV_MEMORY]     = { { 4, 1, 32 }, { 32, 1, 128 }, { 16, 1, 32 } },
+};
+
+static const char *kindNames[DEV_NUM_KINDS] = {
+    "unknown", "nvme", "ssd", "rotational", "network", "memory"
+};
+
+const char *deviceKindName(DeviceKind kind) {
+    return (kind >= 0 && kind < DEV_NUM_KINDS) ? kindNames[kind] : "?";
+}
+
+// ===============================================================
+// DETECTION
+// ===============================================================
+static int readSysInt(const char *dir, const char *file, int *value) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    int ok = fscanf(fp, "%d", value) == 1;
+    fclose(fp);
+    return ok ? 0 : -1;
+}
+
+static DeviceKind detectKind(dev_t dev, const struct statfs *sfs, char *name, size_t nameLen) {
+    char sysLink[64], sysPath[PATH_MAX];
+    int rotational;
+
+    snprintf(name, nameLen, "%u:%u", major(dev), minor(dev));
+
+    if (sfs) {
+        switch ((unsigned long)sfs->f_type) {
+            case NFS_SUPER_MAGIC:
+            case SMB_SUPER_MAGIC:
+            case CIFS_SUPER_MAGIC:
+            case SMB2_SUPER_MAGIC:
+            case CEPH_SUPER_MAGIC:
+            case FUSE_SUPER_MAGIC:
+                return DEV_NETWORK;
+            case TMPFS_MAGIC:
+            case RAMFS_MAGIC:
+                return DEV_MEMORY;
+        }
+    }
+
+    // /sys/dev/block/MAJ:MIN links to the disk or to a partition of it;
+    // partitions have no queue/ directory, their parent disk does
+    snprintf(sysLink, sizeof(sysLink), "/sys/dev/block/%u:%u", major(dev), minor(dev));
+    if (!realpath(sysLink, sysPath)) return DEV_UNKNOWN;
+
+    const char *base = strrchr(sysPath, '/');
+    base = base ? base + 1 : sysPath;
+    size_t len = strlen(base);
+    if (len >= nameLen) len = nameLen - 1;
+    memcpy(name, base, len);
+    name[len] = '\0';
+
+    if (readSysInt(sysPath, "queue/rotational", &rotational) != 0 &&
+        readSysInt(sysPath, "../queue/rotational", &rotational) != 0)
+        return DEV_UNKNOWN;
+
+    if (rotational) return DEV_ROTATIONAL;
+    return strncmp(name, "nvme", 4) == 0 ? DEV_NVME : DEV_SSD;
+}
+
+// Lock-free lookup: the registry only grows, and the count is published
+// after the new pointer is in place.
+static DeviceProfile *findDevice(dev_t dev) {
+    int n = __atomic_load_n(&deviceCount, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; i++)
+        if (devices[i]->dev == dev) return devices[i];
+    return NULL;
+}
+
+static DeviceProfile *addDevice(dev_t dev, const struct statfs *sfs) {
+    pthread_mutex_lock(&registryLock);
+    DeviceProfile *d = findDevice(dev);
+
+    if (!d && deviceCount < MAX_DEVICES && (d = calloc(1, sizeof(DeviceProfile)))) {
+        d->dev = dev;
+        d->kind = detectKind(dev, sfs, d->name, sizeof(d->name));
+        pthread_mutex_init(&d->lock, NULL);
+        pthread_cond_init(&d->freed, NULL);
+
+        for (int l = 0; l < DEV_NUM_LANES; l++) {
+            TuneLane *lane = &d->lanes[l];
+            lane->limit = laneDefaults[d->kind][l][0];
+            lane->minLimit = laneDefaults[d->kind][l][1];
+            lane->maxLimit = laneDefaults[d->kind][l][2];
+            lane->direction = 1;
+            lane->windowStart = metricsNow();
+        }
+
+        // No point in more walker slots than walker threads
+        TuneLane *walk = &d->lanes[DEV_LANE_WALK];
+        if (walk->maxLimit > deviceConfig.maxJobs) walk->maxLimit = deviceConfig.maxJobs;
+        if (walk->limit > walk->maxLimit) walk->limit = walk->maxLimit;
+        if (walk->minLimit > walk->maxLimit) walk->minLimit = walk->maxLimit;
+
+        devices[deviceCount] = d;
+        __atomic_store_n(&deviceCount, deviceCount + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&registryLock);
+    return d;
+}
+
+// Profile for st_dev 'dev'. The first time a device is seen it is
+// classified, using 'path' (any file on it, may be NULL) for statfs().
+DeviceProfile *deviceFor(dev_t dev, const char *path) {
+    struct statfs sfs;
+    DeviceProfile *d = findDevice(dev);
+    if (d) return d;
+    return addDevice(dev, (path && statfs(path, &sfs) == 0) ? &sfs : NULL);
+}
+
+DeviceProfile *deviceForFd(int fd) {
+    struct stat st;
+    struct statfs sfs;
+
+    if (fstat(fd, &st) != 0) return NULL;
+    DeviceProfile *d = findDevice(st.st_dev);
+    if (d) return d;
+    return addDevice(st.st_dev, fstatfs(fd, &sfs) == 0 ? &sfs : NULL);
+}
+
+// ===============================================================
+// ONLINE TUNING
+// ===============================================================
+// Hill climbing on throughput: keep moving the limit in the current
+// direction while throughput improves, turn around when it drops. A
+// latency blow-up with no throughput gain (queueing, seek storms) also
+// turns the limit down. Only windows in which the limit was actually
+// reached say anything about it.
+static void tuneLane(TuneLane *lane, unsigned long long now) {
+    double secs = (now - lane->windowStart) / 1e9;
+    double throughput = lane->windowItems / secs;
+    double latency = (double)lane->windowLatencyNs / lane->windowOps;
+
+    if (lane->bestLatencyNs == 0 || latency < lane->bestLatencyNs)
+        lane->bestLatencyNs = latency;
+
+    if (deviceConfig.tune && lane->saturated) {
+        if (lane->lastThroughput > 0) {
+            if (throughput < lane->lastThroughput * (1 - TUNE_TOLERANCE))
+                lane->direction = -lane->direction;
+            else if (throughput < lane->lastThroughput * (1 + TUNE_TOLERANCE) &&
+                     latency > 2 * lane->bestLatencyNs)
+                lane->direction = -1;
+        }
+
+        int step = lane->limit / 4 > 1 ? lane->limit / 4 : 1;
+        int next = lane->limit + lane->direction * step;
+        if (next < lane->minLimit) { next = lane->minLimit; lane->direction = 1; }
+        if (next > lane->maxLimit) { next = lane->maxLimit; lane->direction = -1; }
+        if (next != lane->limit) lane->adjustments++;
+        lane->limit = next;
+    }
+
+    lane->lastThroughput = throughput;
+    lane->windowStart = now;
+    lane->windowItems = lane->windowOps = lane->windowLatencyNs = 0;
+    lane->saturated = 0;
+}
+
+static void observeLocked(DeviceProfile *d, DeviceLane l, unsigned long long startNs,
+                          unsigned long long items, int saturated) {
+    TuneLane *lane = &d->lanes[l];
+    unsigned long long now = metricsNow();
+
+    lane->windowItems += items;
+    lane->windowOps++;
+    lane->windowLatencyNs += now - startNs;
+    lane->totalItems += items;
+    if (!lane->firstNs) lane->firstNs = startNs;
+    lane->lastNs = now;
+    if (saturated) lane->saturated = 1;
+
+    if (now - lane->windowStart >= TUNE_WINDOW_NS && lane->windowOps >= TUNE_MIN_SAMPLES) {
+        int before = lane->limit;
+        tuneLane(lane, now);
+        if (lane->limit > before) pthread_cond_broadcast(&d->freed);
+    }
+}
+
+// ===============================================================
+// PUBLIC API
+// ===============================================================
+
+// Current limit of a lane (used as the in-flight window by io_uring)
+int deviceWindow(DeviceProfile *d, DeviceLane l) {
+    if (!d) return laneDefaults[DEV_UNKNOWN][l][0];
+    pthread_mutex_lock(&d->lock);
+    int limit = d->lanes[l].limit;
+    pthread_mutex_unlock(&d->lock);
+    return limit;
+}
+
+// Lower the lane's ceiling to 'cap' (e.g. the io_uring queue depth, past
+// which a bigger window cannot be used). Returns the resulting maximum.
+int deviceCapWindow(DeviceProfile *d, DeviceLane l, int cap) {
+    if (!d) {
+        int max = laneDefaults[DEV_UNKNOWN][l][2];
+        return max < cap ? max : cap;
+    }
+    pthread_mutex_lock(&d->lock);
+    TuneLane *lane = &d->lanes[l];
+    if (lane->maxLimit > cap) lane->maxLimit = cap;
+    if (lane->limit > lane->maxLimit) lane->limit = lane->maxLimit;
+    if (lane->minLimit > lane->maxLimit) lane->minLimit = lane->maxLimit;
+    int max = lane->maxLimit;
+    pthread_mutex_unlock(&d->lock);
+    return max;
+}
+
+// Report 'items' (entries, bytes...) completed by one operation that
+// started at startNs and used the full window of lane l. Callers skip
+// operations that were smaller than the window.
+void deviceObserve(DeviceProfile *d, DeviceLane l, unsigned long long startNs, unsigned long long items) {
+    if (!d) return;
+    pthread_mutex_lock(&d->lock);
+    observeLocked(d, l, startNs, items, 1);
+    pthread_mutex_unlock(&d->lock);
+}
+
+// Block until the lane has a free slot; returns the start timestamp to
+// pass to deviceRelease().
+unsigned long long deviceAcquire(DeviceProfile *d, DeviceLane l) {
+    if (!d) return metricsNow();
+
+    pthread_mutex_lock(&d->lock);
+    TuneLane *lane = &d->lanes[l];
+    while (lane->active >= lane->limit) {
+        lane->saturated = 1;
+        pthread_cond_wait(&d->freed, &d->lock);
+    }
+    lane->active++;
+    if (lane->active == lane->limit) lane->saturated = 1;
+    pthread_mutex_unlock(&d->lock);
+    return metricsNow();
+}
+
+void deviceRelease(DeviceProfile *d, DeviceLane l, unsigned long long startNs, unsigned long long items) {
+    if (!d) return;
+
+    pthread_mutex_lock(&d->lock);
+    d->lanes[l].active--;
+    observeLocked(d, l, startNs, items, 0);
+    pthread_cond_broadcast(&d->freed);
+    pthread_mutex_unlock(&d->lock);
+}
+
+void printDeviceSummary(FILE *fp) {
+    static const char *laneNames[DEV_NUM_LANES] = { "walk", "meta", "data" };
+
+    pthread_mutex_lock(&registryLock);
+    if (deviceCount > 0) {
+        fprintf(fp, "------------------------- Devices -------------------------\n");
+        fprintf(fp, "%-14s %-10s %-5s %6s %8s %14s\n", "device", "kind", "lane", "limit", "changes", "items/s");
+    }
+    for (int i = 0; i < deviceCount; i++) {
+        DeviceProfile *d = devices[i];
+        pthread_mutex_lock(&d->lock);
+        for (int l = 0; l < DEV_NUM_LANES; l++) {
+            const TuneLane *lane = &d->lanes[l];
+            if (lane->totalItems == 0) continue;
+            fprintf(fp, "%-14s %-10s %-5s %6d %8d %14.0f\n", d->name, deviceKindName(d->kind),
+                    laneNames[l], lane->limit, lane->adjustments,
+                    lane->lastNs > lane->firstNs ? lane->totalItems / ((lane->lastNs - lane->firstNs) / 1e9) : 0.0);
+        }
+        pthread_mutex_unlock(&d->lock);
+    }
+    if (deviceCount > 0)
+        fprintf(fp, "-----------------------------------------------------------\n");
+    pthread_mutex_unlock(&registryLock);
+}
+
+// Parse one device flag. Returns the number of arguments consumed.
+//   --jobs N     at most N walker threads in total (1 = serial walk)
+//   --no-tune    keep the per-device starting limits
+int parseDeviceFlag(int argc, char *argv[]) {
+    if (strcmp(argv[0], "--jobs") == 0 && argc > 1) {
+        deviceConfig.maxJobs = atoi(argv[1]);
+        if (deviceConfig.maxJobs < 1) deviceConfig.maxJobs = 1;
+        if (deviceConfig.maxJobs > DEVICE_MAX_JOBS) deviceConfig.maxJobs = DEVICE_MAX_JOBS;
+        return 2;
+    }
+    if (strcmp(argv[0], "--no-tune") == 0) {
+        deviceConfig.tune = 0;
+        return 1;
+    }
+    return 0;
+}
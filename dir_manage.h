@@ -15,18 +15,239 @@
 #include <semaphore.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stdint.h>
 
 // ===========================================================
 // FILE INFO STRUCT
 // ===========================================================
 typedef struct FileInfo {
     char name[256];
-    off_t size;
+    off_t size;          // apparent size (st_size)
+    off_t allocated;     // allocated on disk (st_blocks * 512)
     char owner[64];
     char group[64];
     time_t modified;
 } FileInfo;
 
+// ===========================================================
+// TRAVERSAL POLICY + VISITED INODES (traverse.c)
+// ===========================================================
+typedef struct TraversalPolicy {
+    int followSymlinks;   // 1 = stat() (default), 0 = lstat(), symlinks skipped
+    int oneFilesystem;    // 1 = do not cross mount points (-xdev)
+} TraversalPolicy;
+
+extern TraversalPolicy traversalPolicy;
+
+typedef struct InodeSet InodeSet;
+
+InodeSet *createInodeSet(void);
+void destroyInodeSet(InodeSet *set);
+int inodeSetInsert(InodeSet *set, dev_t dev, ino_t ino);
+int inodeSetContains(InodeSet *set, dev_t dev, ino_t ino);
+
+// Per-walk state: root device + every (dev, inode) seen so far
+typedef struct TraversalState {
+    dev_t rootDev;
+    InodeSet *visited;      // real directories and file data
+    InodeSet *linkedDirs;   // directories walked through a symlink
+    InodeSet *primaries;    // hardlinked files seen on a real path
+} TraversalState;
+
+int traversalStart(TraversalState *ts, const char *root);
+void traversalEnd(TraversalState *ts);
+int traversalEnterDir(TraversalState *ts, const struct stat *st, int viaLink);
+int traversalFirstVisit(TraversalState *ts, const struct stat *st, int viaLink);
+int traversalPrimaryPath(TraversalState *ts, const struct stat *st, int viaLink);
+int statForTraversal(const char *path, struct stat *st, int *wasLink);
+int parseTraversalFlag(const char *arg);
+
+// Whole directory read up front: names plus one (possibly batched)
+// stat per entry. dirFd stays open until freeDirListing().
+typedef struct DirListing {
+    int dirFd;
+    int count;
+    char **names;
+    struct stat *st;
+    int *err;            // 0 or errno of the stat for names[i]
+    unsigned char *isLink;  // names[i] is a symlink (st[i] is its target)
+    char *arena;
+} DirListing;
+
+int readDirListing(const char *path, int followSymlinks, DirListing *dl);
+void freeDirListing(DirListing *dl);
+
+// ===========================================================
+// I/O BACKEND (iouring.c)
+// ===========================================================
+// Optional io_uring backend. Falls back to plain syscalls automatically
+// when disabled or when the kernel / sandbox does not allow io_uring.
+#define IO_DEFAULT_QUEUE_DEPTH 32
+#define IO_MAX_QUEUE_DEPTH     4096
+
+typedef struct IoBackendConfig {
+    int useIoUring;
+    unsigned queueDepth;
+} IoBackendConfig;
+
+extern IoBackendConfig ioBackend;
+
+int ioUringAvailable(void);
+void ioStatBatch(int dirFd, const char *const names[], int n, int flags,
+                 struct stat out[], int err[]);
+void ioUnlinkBatch(int dirFd, const char *const names[], const int flags[], int n, int err[]);
+int ioCopyData(int in, int out, off_t size, off_t *copied, uint32_t *crc);
+int parseIoBackendFlag(int argc, char *argv[]);
+
+// ===========================================================
+// I/O THROTTLING (throttle.c)
+// ===========================================================
+// Limits for maintenance jobs: cleanup deletes, recursive delete, copy.
+typedef struct ThrottleConfig {
+    double opsPerSec;       // file operations per second, 0 = unlimited
+    double bytesPerSec;     // data bytes per second, 0 = unlimited
+    int idleIoPriority;     // ioprio_set(IOPRIO_CLASS_IDLE)
+    int adaptive;           // back off when syscall latency rises
+} ThrottleConfig;
+
+extern ThrottleConfig throttleConfig;
+
+int applyThrottleConfig(void);
+void throttleAcquire(unsigned ops, unsigned long long bytes);
+unsigned long long throttleNow(void);
+void throttleObserve(unsigned long long latencyNs);
+int parseThrottleFlag(int argc, char *argv[]);
+
+// ===========================================================
+// DEVICE-AWARE CONCURRENCY (devices.c)
+// ===========================================================
+// Each device gets its own limits for walker threads, io_uring metadata
+// depth and copy window, picked by device kind and tuned while running.
+typedef enum {
+    DEV_UNKNOWN, DEV_NVME, DEV_SSD, DEV_ROTATIONAL, DEV_NETWORK, DEV_MEMORY,
+    DEV_NUM_KINDS
+} DeviceKind;
+
+typedef enum {
+    DEV_LANE_WALK, DEV_LANE_META, DEV_LANE_DATA,
+    DEV_NUM_LANES
+} DeviceLane;
+
+#define DEVICE_DEFAULT_JOBS 16
+#define DEVICE_MAX_JOBS     64
+
+typedef struct DeviceConfig {
+    int maxJobs;            // walker threads in total
+    int tune;               // adjust limits from observed throughput
+} DeviceConfig;
+
+extern DeviceConfig deviceConfig;
+
+typedef struct DeviceProfile DeviceProfile;
+
+const char *deviceKindName(DeviceKind kind);
+DeviceProfile *deviceFor(dev_t dev, const char *path);
+DeviceProfile *deviceForFd(int fd);
+int deviceWindow(DeviceProfile *d, DeviceLane l);
+int deviceCapWindow(DeviceProfile *d, DeviceLane l, int cap);
+void deviceObserve(DeviceProfile *d, DeviceLane l, unsigned long long startNs, unsigned long long items);
+unsigned long long deviceAcquire(DeviceProfile *d, DeviceLane l);
+void deviceRelease(DeviceProfile *d, DeviceLane l, unsigned long long startNs, unsigned long long items);
+void printDeviceSummary(FILE *fp);
+int parseDeviceFlag(int argc, char *argv[]);
+
+// ===========================================================
+// CHECKSUMS (crc32c.c)
+// ===========================================================
+// CRC32C, SSE4.2 accelerated when the CPU supports it.
+uint32_t crc32cUpdate(uint32_t crc, const void *buf, size_t len);
+const char *crc32cImplementation(void);     // "sse4.2" or "software"
+
+// ===========================================================
+// DIRECTORY SNAPSHOT / CURSOR (sort.c)
+// ===========================================================
+// A snapshot reads a directory once and then serves sorted pages
+// from memory. Only the part of the order that has been asked for
+// is sorted, so the first page of a huge directory comes back fast.
+typedef struct DirSnapshot DirSnapshot;
+
+// ===========================================================
+// METRICS / INSTRUMENTATION (metrics.c)
+// ===========================================================
+// Per-thread counters and log2 latency histograms per call class.
+// Off unless metricsEnabled is set; build with -DDIR_MANAGE_NO_METRICS
+// to compile the wrappers down to the plain calls.
+typedef enum {
+    MET_OPENDIR,
+    MET_READDIR,
+    MET_STAT,          // stat + lstat
+    MET_NAME_LOOKUP,   // getpwuid + getgrgid
+    MET_OPEN,
+    MET_READ,
+    MET_WRITE,
+    MET_UNLINK,        // unlink, remove, rmdir
+    MET_FORMAT,        // report / listing formatting
+    MET_LOCK_WAIT,     // time spent acquiring fileLock
+    MET_THROTTLE_WAIT, // sleeps imposed by throttle.c
+    MET_NUM_CLASSES
+} MetricClass;
+
+#define MET_NUM_BUCKETS  24    // 2^7 ns (128ns) .. 2^30 ns (~1s)
+#define MET_BUCKET_SHIFT 7
+
+typedef struct MetricsSummary {
+    unsigned long long count[MET_NUM_CLASSES];
+    unsigned long long totalNs[MET_NUM_CLASSES];
+    unsigned long long buckets[MET_NUM_CLASSES][MET_NUM_BUCKETS];
+    unsigned long long bytesRead;
+    unsigned long long bytesWritten;
+} MetricsSummary;
+
+extern int metricsEnabled;
+
+unsigned long long metricsNow(void);
+void metricsRecord(MetricClass cls, unsigned long long startNs);
+void metricsAddBytes(unsigned long long nread, unsigned long long nwritten);
+void metricsSnapshot(MetricsSummary *out);
+void metricsReset(void);
+const char *metricsClassName(MetricClass cls);
+void printMetricsSummary(FILE *fp);
+int exportMetricsPrometheus(const char *outfile);
+
+#ifndef DIR_MANAGE_NO_METRICS
+#define METRIC_START(var)     unsigned long long var = metricsEnabled ? metricsNow() : 0
+#define METRIC_STOP(cls, var) do { if (metricsEnabled) metricsRecord((cls), (var)); } while (0)
+
+DIR *metOpendir(const char *path);
+struct dirent *metReaddir(DIR *dir);
+int metStat(const char *path, struct stat *st);
+int metLstat(const char *path, struct stat *st);
+struct passwd *metGetpwuid(uid_t uid);
+struct group *metGetgrgid(gid_t gid);
+int metOpen(const char *path, int flags, mode_t mode);
+ssize_t metRead(int fd, void *buf, size_t len);
+ssize_t metWrite(int fd, const void *buf, size_t len);
+int metRemove(const char *path);
+int metUnlink(const char *path);
+int metRmdir(const char *path);
+#else
+#define METRIC_START(var)     (void)0
+#define METRIC_STOP(cls, var) ((void)(cls))
+
+#define metOpendir  opendir
+#define metReaddir  readdir
+#define metStat     stat
+#define metLstat    lstat
+#define metGetpwuid getpwuid
+#define metGetgrgid getgrgid
+#define metOpen     open
+#define metRead     read
+#define metWrite    write
+#define metRemove   remove
+#define metUnlink   unlink
+#define metRmdir    rmdir
+#endif
+
 // ===========================================================
 // GLOBAL SYNC VARIABLES (DEFINED IN sync.c)
 // ===========================================================
@@ -52,6 +273,18 @@ void listAndSortDirectory(const char *path, int sortChoice);
 void searchByNameOrExtension(const char *path, const char *pattern);
 void deleteBySRUFilter(const char *path);
 
+// Paginated listing (sortChoice: 1 = name, 2 = size, 3 = date)
+DirSnapshot *openDirSnapshot(const char *path, int sortChoice);
+void closeDirSnapshot(DirSnapshot *snap);
+size_t dirSnapshotCount(const DirSnapshot *snap);
+
+// Offset/limit page. Returns number of entries copied into page[].
+size_t fetchDirPage(DirSnapshot *snap, size_t offset, size_t limit, FileInfo page[]);
+
+// Keyset page: entries strictly after 'after' (the last row of the
+// previous page). Pass NULL for the first page.
+size_t fetchDirPageAfter(DirSnapshot *snap, const FileInfo *after, size_t limit, FileInfo page[]);
+
 // Tree view module (we will add later)
 // void printDirectoryTree(const char *path, int level, int isLast[]);
 
@@ -61,15 +294,30 @@ void deleteBySRUFilter(const char *path);
 void exportReportTXT(const char *path, const char *outfile);
 void exportReportCSV(const char *path, const char *outfile);
 
+// Write an already collected list (used when traversals are shared)
+int writeReportTXT(const char *path, const FileInfo files[], int count, const char *outfile);
+int writeReportCSV(const FileInfo files[], int count, const char *outfile);
+
+// Fill one FileInfo (name, size, owner, group, mtime) from a stat result
+void fillFileInfo(FileInfo *fi, const char *name, const struct stat *st);
+
 // Append delete logs (optional)
 void appendSRULog(const char *action, const char *filepath, long size, const char *owner);
 
+// Same, with the CRC32C of the data as a trailing column (verified copy/move)
+void appendSRULogChecksum(const char *action, const char *filepath, long size,
+                          const char *owner, uint32_t crc);
+
 // Export both TXT + CSV together
 void exportAllReports(const char *path);
 
 // ===========================================================
 // FILE OPERATIONS MODULE (fileops.c)
 // ===========================================================
+// With copyVerify set, copy/move compute CRC32C while streaming, read the
+// destination back from storage and fail (source untouched) on mismatch.
+extern int copyVerify;
+
 int copyFile(const char *src, const char *dst);
 int moveFile(const char *src, const char *dst);
 int renameFile(const char *oldpath, const char *newpath);
@@ -80,6 +328,58 @@ int removeDirectoryRecursive(const char *path);
 // Interactive file operations utility
 void fileOperationsMenu(const char *cwd);
 
+// ===========================================================
+// BATCH / COMMAND MODE (batch.c)
+// ===========================================================
+// Non-interactive entry points. Output is JSON lines on stdout.
+// Exit codes: 0 = all ok, 1 = an operation failed, 2 = usage error.
+#define EXIT_OP_FAILED 1
+#define EXIT_USAGE     2
+
+int runCommandLine(int argc, char *argv[]);
+int runBatchFile(const char *batchfile);
+
+// Helpers shared with the daemon protocol
+int tokenizeLine(char *line, char *argv[], int maxArgs);
+void writeJSONString(FILE *fp, const char *s);
+
+// ===========================================================
+// PACK ARCHIVE (pack.c)
+// ===========================================================
+// Append-only container for cold small files: data blobs followed by
+// a sorted index and a footer. Entries are found by binary search and
+// extracted with positional reads; each carries a CRC32C.
+typedef struct PackEntry {
+    char *name;         // path relative to the packed directory
+    off_t offset;
+    off_t size;
+    time_t mtime;
+    mode_t mode;
+    uint32_t crc;
+} PackEntry;
+
+typedef struct Pack Pack;
+
+Pack *packOpen(const char *path, int forWrite);
+int packAppendFile(Pack *p, const char *srcPath, const char *name, const struct stat *st);
+int packCommit(Pack *p);
+void packClose(Pack *p);
+int packIsSelf(const Pack *p, const struct stat *st);
+int packEntryCount(const Pack *p);
+const PackEntry *packEntryAt(const Pack *p, int i);
+const PackEntry *packFind(const Pack *p, const char *name);
+int packExtract(Pack *p, const PackEntry *e, const char *destDir);
+
+// ===========================================================
+// DAEMON MODE (daemon.c)
+// ===========================================================
+// 'serve' scans roots once, keeps the trees in memory and answers
+// requests over a Unix domain socket; 'query' is the matching client.
+#define DAEMON_DEFAULT_SOCKET "/tmp/dir_manage.sock"
+
+int runDaemon(int argc, char *argv[]);
+int runDaemonQuery(int argc, char *argv[]);
+
 // ===========================================================
 // MAIN MENU
 // ===========================================================
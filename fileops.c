@@ -9,50 +9,117 @@
 #include <unistd.h>
 #include <limits.h>
 
-/* Copy file using read/write loop. Preserves file permissions. */
-int copyFile(const char *src, const char *dst) {
+#define UNLINK_CHUNK 64
+
+int copyVerify = 0;
+
+/* perror() that leaves errno alone: glibc's perror can overwrite it
+   (EINVAL from re-opening stderr), and callers report strerror(errno). */
+static void logError(const char *what) {
+    int saved = errno;
+    perror(what);
+    errno = saved;
+}
+
+/* Checksum the destination as stored: flush it, drop it from the page
+   cache so the read comes from the device, then read it back. */
+static int readBackChecksum(int out_fd, const char *dst, uint32_t *crc) {
+    char buf[65536];
+    ssize_t nread;
+
+    if (fdatasync(out_fd) != 0) {
+        logError("fdatasync(dst)");
+        return -1;
+    }
+    posix_fadvise(out_fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    int fd = metOpen(dst, O_RDONLY, 0);
+    if (fd < 0) {
+        logError("open(dst) for verify");
+        return -1;
+    }
+    *crc = 0;
+    while ((nread = metRead(fd, buf, sizeof(buf))) > 0)
+        *crc = crc32cUpdate(*crc, buf, (size_t)nread);
+    if (nread < 0) logError("read(dst) for verify");
+    close(fd);
+    return nread < 0 ? -1 : 0;
+}
+
+/* Copy file using read/write loop. Preserves file permissions.
+   With copyVerify set, *crc receives the checksum of the copied data
+   (computed while streaming) after it matched a read-back of dst. */
+static int copyFileChecked(const char *src, const char *dst, struct stat *stOut, uint32_t *crcOut) {
     int in_fd = -1, out_fd = -1;
     ssize_t nread;
     char buf[65536]; // 64 KB buffer
     struct stat st;
+    uint32_t crc = 0;
+    uint32_t *crcp = copyVerify ? &crc : NULL;
 
-    if (stat(src, &st) != 0) {
-        perror("stat(src)");
+    if (metStat(src, &st) != 0) {
+        logError("stat(src)");
         return -1;
     }
+    if (stOut) *stOut = st;
+
+    throttleAcquire(1, 0);
 
-    in_fd = open(src, O_RDONLY);
+    /* dst is only created/truncated once src is known to be readable */
+    in_fd = metOpen(src, O_RDONLY, 0);
     if (in_fd < 0) {
-        perror("open(src)");
+        logError("open(src)");
         return -1;
     }
 
-    /* create dst with same mode */
-    out_fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+    out_fd = metOpen(dst, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
     if (out_fd < 0) {
-        perror("open(dst)");
+        logError("open(dst)");
         close(in_fd);
         return -1;
     }
 
-    while ((nread = read(in_fd, buf, sizeof(buf))) > 0) {
+    /* bulk of the data through the io_uring pipeline when enabled */
+    {
+        off_t copied = 0;
+        int rc = ioCopyData(in_fd, out_fd, st.st_size, &copied, crcp);
+        if (rc < 0) {
+            logError("copy");
+            close(in_fd);
+            close(out_fd);
+            return -1;
+        }
+        if (rc == 0) {
+            /* the loop below picks up anything appended since stat() */
+            lseek(in_fd, copied, SEEK_SET);
+            lseek(out_fd, copied, SEEK_SET);
+        }
+    }
+
+    while ((nread = metRead(in_fd, buf, sizeof(buf))) > 0) {
         char *out_ptr = buf;
         ssize_t nwritten;
+        unsigned long long t0;
+
+        throttleAcquire(0, (unsigned long long)nread);
+        if (crcp) crc = crc32cUpdate(crc, buf, (size_t)nread);
+        t0 = throttleNow();
         do {
-            nwritten = write(out_fd, out_ptr, nread);
+            nwritten = metWrite(out_fd, out_ptr, nread);
             if (nwritten >= 0) {
                 nread -= nwritten;
                 out_ptr += nwritten;
             } else if (errno != EINTR) {
-                perror("write");
+                logError("write");
                 close(in_fd);
                 close(out_fd);
                 return -1;
             }
         } while (nread > 0);
+        throttleObserve(throttleNow() - t0);
     }
     if (nread < 0) {
-        perror("read");
+        logError("read");
         close(in_fd);
         close(out_fd);
         return -1;
@@ -73,38 +140,83 @@ int copyFile(const char *src, const char *dst) {
 #endif
 
     close(in_fd);
+
+    if (crcp) {
+        uint32_t stored;
+        if (readBackChecksum(out_fd, dst, &stored) != 0) {
+            close(out_fd);
+            return -1;
+        }
+        if (stored != crc) {
+            fprintf(stderr, "verify: %s: checksum mismatch (crc32c %08x, read back %08x)\n",
+                    dst, crc, stored);
+            close(out_fd);
+            metUnlink(dst);     /* never leave a corrupt copy behind */
+            errno = EIO;
+            return -1;
+        }
+        *crcOut = crc;
+    }
+
     close(out_fd);
     return 0;
 }
 
-/* Move file: try rename() first, otherwise copy+unlink */
+/* Record a verified transfer (and its checksum) in the SRU log */
+static void logVerified(const char *action, const char *src, const struct stat *st, uint32_t crc) {
+    struct passwd *pw = metGetpwuid(st->st_uid);
+    appendSRULogChecksum(action, src, (long)st->st_size, pw ? pw->pw_name : "unknown", crc);
+}
+
+int copyFile(const char *src, const char *dst) {
+    struct stat st;
+    uint32_t crc;
+
+    if (copyFileChecked(src, dst, &st, &crc) != 0) return -1;
+    if (copyVerify) logVerified("COPIED", src, &st, crc);
+    return 0;
+}
+
+/* Move file: try rename() first, otherwise copy+unlink.
+   In verify mode the source is only unlinked after the copy has been
+   read back and matched its checksum. */
 int moveFile(const char *src, const char *dst) {
+    struct stat st;
+    uint32_t crc;
+
     if (rename(src, dst) == 0) return 0;
 
     /* rename failed — try copy then unlink */
-    if (copyFile(src, dst) != 0) return -1;
+    if (copyFileChecked(src, dst, &st, &crc) != 0) return -1;
 
-    if (unlink(src) != 0) {
-        perror("unlink(src) after copy");
+    if (metUnlink(src) != 0) {
+        logError("unlink(src) after copy");
         return -1;
     }
+    if (copyVerify) logVerified("MOVED", src, &st, crc);
     return 0;
 }
 
 /* Rename (wrapper) */
 int renameFile(const char *oldpath, const char *newpath) {
     if (rename(oldpath, newpath) == 0) return 0;
-    perror("rename");
+    logError("rename");
     return -1;
 }
 
 /* Thread-safe delete single file */
 int deleteFile(const char *path) {
-    int rc;
+    int rc, err;
+    unsigned long long t0;
+    throttleAcquire(1, 0);
     lockFileOps();
-    rc = remove(path);
-    if (rc != 0) perror("remove");
+    t0 = throttleNow();
+    rc = metRemove(path);
+    err = errno;
+    throttleObserve(throttleNow() - t0);
+    if (rc != 0) logError("remove");
     unlockFileOps();
+    errno = err;    /* callers may report strerror(errno) */
     return rc;
 }
 
@@ -112,69 +224,97 @@ int deleteFile(const char *path) {
 int createDirectory(const char *path, mode_t mode) {
     if (mkdir(path, mode) == 0) return 0;
     if (errno == EEXIST) return 0;
-    perror("mkdir");
+    logError("mkdir");
     return -1;
 }
 
-/* Recursively remove directory contents then directory itself */
+/* Recursively remove directory contents then directory itself.
+   Subdirectories are emptied first, then every entry of this directory
+   is unlinked in one batch (io_uring when enabled). */
 static int removeDirContents(const char *path) {
-    struct dirent *de;
-    struct stat st;
+    DirListing dl;
     char child[PATH_MAX];
-    DIR *dr = opendir(path);
-    if (!dr) {
-        perror("opendir in removeDirContents");
+    int rc = 0;
+
+    if (readDirListing(path, 0, &dl) != 0) {
+        logError("opendir in removeDirContents");
         return -1;
     }
 
-    while ((de = readdir(dr)) != NULL) {
-        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+    int *flags = malloc(sizeof(int) * (dl.count ? dl.count : 1));
+    int *err = malloc(sizeof(int) * (dl.count ? dl.count : 1));
+    if (!flags || !err) {
+        free(flags);
+        free(err);
+        freeDirListing(&dl);
+        errno = ENOMEM;
+        logError("removeDirContents");
+        return -1;
+    }
 
-        snprintf(child, sizeof(child), "%s/%s", path, de->d_name);
-        if (lstat(child, &st) != 0) {
-            perror("lstat");
-            closedir(dr);
-            return -1;
+    for (int i = 0; i < dl.count; i++) {
+        if (dl.err[i] != 0) {
+            errno = dl.err[i];
+            logError("lstat");
+            rc = -1;
+            break;
         }
 
-        if (S_ISDIR(st.st_mode)) {
-            if (removeDirContents(child) != 0) {
-                closedir(dr);
-                return -1;
+        flags[i] = 0;
+        if (S_ISDIR(dl.st[i].st_mode)) {
+            if (snprintf(child, sizeof(child), "%s/%s", path, dl.names[i]) >= (int)sizeof(child)) {
+                errno = ENAMETOOLONG;
+                logError(dl.names[i]);
+                rc = -1;
+                break;
             }
-            /* remove the now-empty subdir */
-            lockFileOps();
-            if (rmdir(child) != 0) {
-                perror("rmdir");
-                unlockFileOps();
-                closedir(dr);
-                return -1;
+            if (removeDirContents(child) != 0) {
+                rc = -1;
+                break;
             }
-            unlockFileOps();
-        } else {
-            lockFileOps();
-            if (remove(child) != 0) {
-                perror("remove (file)");
-                unlockFileOps();
-                closedir(dr);
-                return -1;
+            flags[i] = AT_REMOVEDIR;    /* remove the now-empty subdir */
+        }
+    }
+
+    /* throttled jobs unlink in small chunks so the rate stays smooth */
+    int chunk = (throttleConfig.opsPerSec > 0 || throttleConfig.adaptive) ? UNLINK_CHUNK : dl.count;
+
+    for (int start = 0; rc == 0 && start < dl.count; start += chunk) {
+        int n = dl.count - start < chunk ? dl.count - start : chunk;
+        unsigned long long t0;
+
+        throttleAcquire((unsigned)n, 0);
+        lockFileOps();
+        t0 = throttleNow();
+        ioUnlinkBatch(dl.dirFd, (const char *const *)dl.names + start, flags + start, n, err + start);
+        throttleObserve((throttleNow() - t0) / (unsigned long long)n);
+        unlockFileOps();
+
+        for (int i = start; i < start + n; i++) {
+            if (err[i] != 0) {
+                errno = err[i];
+                logError(flags[i] ? "rmdir" : "remove (file)");
+                rc = -1;
+                break;
             }
-            unlockFileOps();
         }
     }
 
-    closedir(dr);
-    return 0;
+    free(flags);
+    free(err);
+    freeDirListing(&dl);
+    return rc;
 }
 
 int removeDirectoryRecursive(const char *path) {
     struct stat st;
-    if (stat(path, &st) != 0) {
-        perror("stat");
+    if (metStat(path, &st) != 0) {
+        logError("stat");
         return -1;
     }
     if (!S_ISDIR(st.st_mode)) {
         fprintf(stderr, "%s is not a directory\n", path);
+        errno = ENOTDIR;
         return -1;
     }
 
@@ -182,8 +322,8 @@ int removeDirectoryRecursive(const char *path) {
 
     /* now remove the top directory */
     lockFileOps();
-    if (rmdir(path) != 0) {
-        perror("rmdir top");
+    if (metRmdir(path) != 0) {
+        logError("rmdir top");
         unlockFileOps();
         return -1;
     }
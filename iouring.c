@@ -0,0 +1,522 @@
+// iouring.c
+// Optional io_uring execution backend: batched statx, read/write and
+// unlinkat. Talks to the kernel through the raw syscalls (no liburing).
+//
+// Each thread lazily sets up its own ring the first time it needs one.
+// If io_uring is disabled, unsupported (ENOSYS) or blocked (EPERM under
+// seccomp), every function here falls back to the plain syscalls. The
+// same happens per operation when the kernel's ring lacks the opcode
+// (statx/openat/read/write need 5.6, unlinkat 5.11).
+#define _GNU_SOURCE
+#include "dir_manage.h"
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+
+IoBackendConfig ioBackend = { .useIoUring = 0, .queueDepth = IO_DEFAULT_QUEUE_DEPTH };
+
+#define COPY_CHUNK_SIZE 65536
+
+typedef struct IoRing {
+    int fd;
+    unsigned entries;
+
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    struct io_uring_sqe *sqes;
+    unsigned sqLocalTail;
+    unsigned unsubmitted;
+
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+
+    void *sqRing, *cqRing;
+    size_t sqRingLen, cqRingLen, sqesLen;
+
+    unsigned char opSupported[256];     // from IORING_REGISTER_PROBE
+} IoRing;
+
+static pthread_key_t ringKey;
+static pthread_once_t ringKeyOnce = PTHREAD_ONCE_INIT;
+static __thread IoRing *threadRing = NULL;
+static __thread int threadRingFailed = 0;
+
+// ===============================================================
+// RING SETUP / TEARDOWN
+// ===============================================================
+static void destroyRing(void *arg) {
+    IoRing *r = arg;
+    if (!r) return;
+    if (r->sqes) munmap(r->sqes, r->sqesLen);
+    if (r->cqRing && r->cqRing != r->sqRing) munmap(r->cqRing, r->cqRingLen);
+    if (r->sqRing) munmap(r->sqRing, r->sqRingLen);
+    if (r->fd >= 0) close(r->fd);
+    free(r);
+}
+
+static void makeRingKey(void) {
+    pthread_key_create(&ringKey, destroyRing);
+}
+
+// Record which opcodes this kernel accepts. Kernels older than 5.6 have
+// no probe at all; they also lack every opcode used here.
+static void probeOps(IoRing *r) {
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+    if (!probe) return;
+
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        for (int i = 0; i < probe->ops_len; i++)
+            if (probe->ops[i].flags & IO_URING_OP_SUPPORTED)
+                r->opSupported[probe->ops[i].op] = 1;
+    }
+    free(probe);
+}
+
+static IoRing *setupRing(unsigned depth) {
+    struct io_uring_params p;
+    IoRing *r = calloc(1, sizeof(IoRing));
+    if (!r) return NULL;
+
+    memset(&p, 0, sizeof(p));
+    r->fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+    if (r->fd < 0) {
+        free(r);
+        return NULL;
+    }
+    r->entries = p.sq_entries;
+
+    r->sqRingLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cqRingLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cqRingLen > r->sqRingLen) r->sqRingLen = r->cqRingLen;
+        r->cqRingLen = r->sqRingLen;
+    }
+
+    r->sqRing = mmap(NULL, r->sqRingLen, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sqRing == MAP_FAILED) { r->sqRing = NULL; destroyRing(r); return NULL; }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cqRing = r->sqRing;
+    } else {
+        r->cqRing = mmap(NULL, r->cqRingLen, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cqRing == MAP_FAILED) { r->cqRing = NULL; destroyRing(r); return NULL; }
+    }
+
+    r->sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqesLen, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) { r->sqes = NULL; destroyRing(r); return NULL; }
+
+    char *sq = r->sqRing, *cq = r->cqRing;
+    r->sqHead  = (unsigned *)(sq + p.sq_off.head);
+    r->sqTail  = (unsigned *)(sq + p.sq_off.tail);
+    r->sqMask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sqArray = (unsigned *)(sq + p.sq_off.array);
+    r->cqHead  = (unsigned *)(cq + p.cq_off.head);
+    r->cqTail  = (unsigned *)(cq + p.cq_off.tail);
+    r->cqMask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes    = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    r->sqLocalTail = *r->sqTail;
+    probeOps(r);
+    return r;
+}
+
+// The calling thread's ring, or NULL when io_uring cannot be used at all
+static IoRing *threadRingGet(void) {
+    if (!ioBackend.useIoUring || threadRingFailed) return NULL;
+    if (threadRing) return threadRing;
+
+    pthread_once(&ringKeyOnce, makeRingKey);
+
+    unsigned depth = ioBackend.queueDepth ? ioBackend.queueDepth : IO_DEFAULT_QUEUE_DEPTH;
+    threadRing = setupRing(depth);
+    if (!threadRing) {
+        threadRingFailed = 1;
+        return NULL;
+    }
+    pthread_setspecific(ringKey, threadRing);
+    return threadRing;
+}
+
+// The ring if it can run 'op', or NULL when the sync fallback should be used
+static IoRing *getRing(int op) {
+    IoRing *r = threadRingGet();
+    return (r && r->opSupported[op]) ? r : NULL;
+}
+
+int ioUringAvailable(void) {
+    return threadRingGet() != NULL;
+}
+
+// ===============================================================
+// SUBMISSION / COMPLETION
+// ===============================================================
+static struct io_uring_sqe *getSqe(IoRing *r) {
+    unsigned head = __atomic_load_n(r->sqHead, __ATOMIC_ACQUIRE);
+    if (r->sqLocalTail - head >= r->entries) return NULL;
+
+    unsigned idx = r->sqLocalTail & *r->sqMask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sqArray[idx] = idx;
+    r->sqLocalTail++;
+    r->unsubmitted++;
+    return sqe;
+}
+
+// Publish queued SQEs and wait for at least one completion
+static int submitAndWait(IoRing *r) {
+    __atomic_store_n(r->sqTail, r->sqLocalTail, __ATOMIC_RELEASE);
+
+    for (;;) {
+        int ret = (int)syscall(__NR_io_uring_enter, r->fd, r->unsubmitted, 1,
+                               IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret >= 0) {
+            r->unsubmitted -= (unsigned)ret;
+            return 0;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return -1;
+    }
+}
+
+// Move every available CQE into results[]; returns how many there were
+static int reapCompletions(IoRing *r, int results[]) {
+    unsigned head = *r->cqHead;
+    unsigned tail = __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE);
+    int reaped = 0;
+
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cqMask];
+        results[cqe->user_data] = cqe->res;
+        head++;
+        reaped++;
+    }
+    __atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+// io_uring_enter failed with requests still in flight, and those point
+// at the caller's buffers. Wait for all of them before the caller can
+// free anything; if even that fails, tear the ring down so nothing can
+// complete later. Either way this thread uses the sync path from now on.
+static void abandonRing(IoRing *r, int outstanding, int results[]) {
+    while (outstanding > 0) {
+        int ret = (int)syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR) break;
+        outstanding -= reapCompletions(r, results);
+    }
+    if (outstanding > 0) {
+        pthread_setspecific(ringKey, NULL);
+        destroyRing(r);
+        threadRing = NULL;
+    }
+    threadRingFailed = 1;
+}
+
+typedef void (*PrepFn)(struct io_uring_sqe *sqe, int idx, void *ctx);
+
+// Run n independent operations keeping up to 'limit' (or queue-depth,
+// whichever is lower) in flight. results[i] receives the raw CQE result
+// (>= 0 or -errno).
+static int runBatch(IoRing *r, int n, int limit, PrepFn prep, void *ctx, int results[], MetricClass cls) {
+    int next = 0, inflight = 0, done = 0;
+
+    while (done < n) {
+        while (next < n && inflight < limit) {
+            struct io_uring_sqe *sqe = getSqe(r);
+            if (!sqe) break;
+            prep(sqe, next, ctx);
+            sqe->user_data = (unsigned long long)next;
+            next++;
+            inflight++;
+        }
+
+        METRIC_START(t);
+        if (submitAndWait(r) != 0) {
+            // SQEs that never reached the kernel are not in flight
+            abandonRing(r, inflight - (int)r->unsubmitted, results);
+            return -1;
+        }
+        METRIC_STOP(cls, t);
+
+        int reaped = reapCompletions(r, results);
+        inflight -= reaped;
+        done += reaped;
+    }
+    return 0;
+}
+
+// ===============================================================
+// BATCHED STATX
+// ===============================================================
+static void statxToStat(const struct statx *sx, struct stat *st) {
+    memset(st, 0, sizeof(*st));
+    st->st_dev = makedev(sx->stx_dev_major, sx->stx_dev_minor);
+    st->st_ino = sx->stx_ino;
+    st->st_mode = sx->stx_mode;
+    st->st_nlink = sx->stx_nlink;
+    st->st_uid = sx->stx_uid;
+    st->st_gid = sx->stx_gid;
+    st->st_size = (off_t)sx->stx_size;
+    st->st_blocks = (blkcnt_t)sx->stx_blocks;
+    st->st_blksize = sx->stx_blksize;
+    st->st_atim.tv_sec = sx->stx_atime.tv_sec;
+    st->st_atim.tv_nsec = sx->stx_atime.tv_nsec;
+    st->st_mtim.tv_sec = sx->stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = sx->stx_mtime.tv_nsec;
+    st->st_ctim.tv_sec = sx->stx_ctime.tv_sec;
+    st->st_ctim.tv_nsec = sx->stx_ctime.tv_nsec;
+}
+
+typedef struct StatCtx {
+    int dirFd;
+    const char *const *names;
+    int flags;
+    struct statx *bufs;
+} StatCtx;
+
+static void prepStatx(struct io_uring_sqe *sqe, int idx, void *arg) {
+    StatCtx *c = arg;
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = c->dirFd;
+    sqe->addr = (unsigned long long)(uintptr_t)c->names[idx];
+    sqe->len = STATX_BASIC_STATS;
+    sqe->statx_flags = (unsigned)c->flags;
+    sqe->off = (unsigned long long)(uintptr_t)&c->bufs[idx];
+}
+
+// In-flight window for a metadata batch on d. The ring cannot hold more
+// than r->entries, so the lane is never tuned past that.
+static int metaWindow(IoRing *r, DeviceProfile *d) {
+    deviceCapWindow(d, DEV_LANE_META, (int)r->entries);
+    return deviceWindow(d, DEV_LANE_META);
+}
+
+// stat n names relative to dirFd. flags: 0 or AT_SYMLINK_NOFOLLOW.
+// err[i] is 0 on success or an errno value.
+void ioStatBatch(int dirFd, const char *const names[], int n, int flags,
+                 struct stat out[], int err[]) {
+    IoRing *r = getRing(IORING_OP_STATX);
+
+    if (r && n > 1) {
+        struct statx *bufs = malloc(sizeof(struct statx) * n);
+        int *res = malloc(sizeof(int) * n);
+        StatCtx ctx = { dirFd, names, flags, bufs };
+        DeviceProfile *d = deviceForFd(dirFd);
+        int limit = metaWindow(r, d);
+        // A batch smaller than the window says nothing about the window
+        unsigned long long t0 = n >= limit ? metricsNow() : 0;
+
+        if (bufs && res && runBatch(r, n, limit, prepStatx, &ctx, res, MET_STAT) == 0) {
+            if (t0) deviceObserve(d, DEV_LANE_META, t0, (unsigned long long)n);
+            for (int i = 0; i < n; i++) {
+                err[i] = res[i] < 0 ? -res[i] : 0;
+                if (!err[i]) statxToStat(&bufs[i], &out[i]);
+            }
+            free(bufs);
+            free(res);
+            return;
+        }
+        free(bufs);
+        free(res);
+    }
+
+    // Sync fallback
+    for (int i = 0; i < n; i++) {
+        METRIC_START(t);
+        err[i] = fstatat(dirFd, names[i], &out[i], flags) == 0 ? 0 : errno;
+        METRIC_STOP(MET_STAT, t);
+    }
+}
+
+// ===============================================================
+// BATCHED UNLINKAT
+// ===============================================================
+typedef struct UnlinkCtx {
+    int dirFd;
+    const char *const *names;
+    const int *flags;
+} UnlinkCtx;
+
+static void prepUnlink(struct io_uring_sqe *sqe, int idx, void *arg) {
+    UnlinkCtx *c = arg;
+    sqe->opcode = IORING_OP_UNLINKAT;
+    sqe->fd = c->dirFd;
+    sqe->addr = (unsigned long long)(uintptr_t)c->names[idx];
+    sqe->unlink_flags = (unsigned)c->flags[idx];
+}
+
+// unlinkat n names relative to dirFd (flags[i]: 0 or AT_REMOVEDIR).
+void ioUnlinkBatch(int dirFd, const char *const names[], const int flags[], int n, int err[]) {
+    IoRing *r = getRing(IORING_OP_UNLINKAT);
+
+    if (r && n > 1) {
+        int *res = malloc(sizeof(int) * n);
+        UnlinkCtx ctx = { dirFd, names, flags };
+        DeviceProfile *d = deviceForFd(dirFd);
+        int limit = metaWindow(r, d);
+        unsigned long long t0 = n >= limit ? metricsNow() : 0;
+
+        if (res && runBatch(r, n, limit, prepUnlink, &ctx, res, MET_UNLINK) == 0) {
+            if (t0) deviceObserve(d, DEV_LANE_META, t0, (unsigned long long)n);
+            for (int i = 0; i < n; i++) err[i] = res[i] < 0 ? -res[i] : 0;
+            free(res);
+            return;
+        }
+        free(res);
+    }
+
+    for (int i = 0; i < n; i++) {
+        METRIC_START(t);
+        err[i] = unlinkat(dirFd, names[i], flags[i]) == 0 ? 0 : errno;
+        METRIC_STOP(MET_UNLINK, t);
+    }
+}
+
+// ===============================================================
+// PIPELINED COPY
+// ===============================================================
+typedef struct CopyCtx {
+    int fd;
+    char *bufs;
+    off_t base;
+    const int *lens;
+    int write;
+} CopyCtx;
+
+static void prepRw(struct io_uring_sqe *sqe, int idx, void *arg) {
+    CopyCtx *c = arg;
+    sqe->opcode = c->write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = c->fd;
+    sqe->addr = (unsigned long long)(uintptr_t)(c->bufs + (size_t)idx * COPY_CHUNK_SIZE);
+    sqe->len = (unsigned)c->lens[idx];
+    sqe->off = (unsigned long long)(c->base + (off_t)idx * COPY_CHUNK_SIZE);
+}
+
+static int finishWrite(int fd, const char *buf, size_t len, off_t off) {
+    while (len > 0) {
+        ssize_t w = pwrite(fd, buf, len, off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += w;
+        len -= (size_t)w;
+        off += w;
+    }
+    return 0;
+}
+
+// Copy up to 'size' bytes from in to out (by offset; file positions are
+// not moved) with a window of reads, then the matching writes, in flight
+// at a time. The window is the source device's data lane limit, capped
+// at the queue depth. *copied is set to the contiguous prefix written
+// (a valid resume offset) and, when crc is not NULL, that data is folded
+// into the running CRC32C.
+// Returns 0 on success, 1 if the ring is unavailable (caller should use
+// its own loop), -1 on error.
+int ioCopyData(int in, int out, off_t size, off_t *copied, uint32_t *crc) {
+    IoRing *r = getRing(IORING_OP_READ);
+    *copied = 0;
+    if (!r || !r->opSupported[IORING_OP_WRITE] || size <= COPY_CHUNK_SIZE) return 1;
+
+    // Buffers only for the largest window the device lane can ask for
+    DeviceProfile *d = deviceForFd(in);
+    int window = deviceCapWindow(d, DEV_LANE_DATA, (int)r->entries);
+    char *bufs = malloc((size_t)window * COPY_CHUNK_SIZE);
+    int *lens = malloc(sizeof(int) * window);
+    int *res = malloc(sizeof(int) * window);
+    int rc = 0;
+
+    if (!bufs || !lens || !res) {
+        free(bufs); free(lens); free(res);
+        return 1;
+    }
+
+    int n = 0;
+    for (off_t base = 0; base < size && rc == 0; base += (off_t)n * COPY_CHUNK_SIZE) {
+        int limit = deviceWindow(d, DEV_LANE_DATA);
+        if (limit > window) limit = window;
+
+        for (n = 0; n < limit && base + (off_t)n * COPY_CHUNK_SIZE < size; n++) {
+            off_t left = size - base - (off_t)n * COPY_CHUNK_SIZE;
+            lens[n] = left < COPY_CHUNK_SIZE ? (int)left : COPY_CHUNK_SIZE;
+        }
+
+        // Timed only for the tuner (full windows) or adaptive throttling
+        unsigned long long windowBytes = 0, t0;
+        for (int i = 0; i < n; i++) windowBytes += (unsigned long long)lens[i];
+        throttleAcquire(0, windowBytes);
+        t0 = n >= limit ? metricsNow() : throttleNow();
+
+        CopyCtx rd = { in, bufs, base, lens, 0 };
+        if (runBatch(r, n, n, prepRw, &rd, res, MET_READ) != 0) { rc = -1; break; }
+
+        // A short read ends the window at that slot: later slots hold data
+        // from past a gap, so only the contiguous prefix is written and
+        // the caller's loop resumes at *copied
+        int eof = 0;
+        for (int i = 0; i < n; i++) {
+            if (res[i] < 0) { errno = -res[i]; rc = -1; break; }
+            metricsAddBytes((unsigned long long)res[i], 0);
+            if (res[i] < lens[i]) {
+                lens[i] = res[i];
+                n = i + 1;
+                eof = 1;
+            }
+        }
+        if (rc != 0) break;
+
+        // Checksum the window while it is still hot in cache
+        for (int i = 0; crc && i < n; i++)
+            *crc = crc32cUpdate(*crc, bufs + (size_t)i * COPY_CHUNK_SIZE, (size_t)lens[i]);
+
+        CopyCtx wr = { out, bufs, base, lens, 1 };
+        if (runBatch(r, n, n, prepRw, &wr, res, MET_WRITE) != 0) { rc = -1; break; }
+
+        for (int i = 0; i < n; i++) {
+            if (res[i] < 0) { errno = -res[i]; rc = -1; break; }
+            metricsAddBytes(0, (unsigned long long)res[i]);
+            *copied += lens[i];
+            // A short write finishes synchronously
+            if (res[i] < lens[i] &&
+                finishWrite(out, bufs + (size_t)i * COPY_CHUNK_SIZE + res[i],
+                            (size_t)(lens[i] - res[i]),
+                            base + (off_t)i * COPY_CHUNK_SIZE + res[i]) != 0) {
+                rc = -1;
+                break;
+            }
+        }
+        throttleObserve((t0 ? metricsNow() - t0 : 0) / (unsigned long long)n);
+        if (n >= limit) deviceObserve(d, DEV_LANE_DATA, t0, windowBytes);
+        if (eof) break;
+    }
+
+    free(bufs);
+    free(lens);
+    free(res);
+    return rc;
+}
+
+// Parse one backend flag (--io-uring, --queue-depth N, at most
+// IO_MAX_QUEUE_DEPTH).
+// Returns the number of arguments consumed (0 if not a backend flag).
+int parseIoBackendFlag(int argc, char *argv[]) {
+    if (strcmp(argv[0], "--io-uring") == 0) {
+        ioBackend.useIoUring = 1;
+        return 1;
+    }
+    if (strcmp(argv[0], "--queue-depth") == 0 && argc > 1) {
+        int qd = atoi(argv[1]);
+        if (qd <= 0) qd = IO_DEFAULT_QUEUE_DEPTH;
+        if (qd > IO_MAX_QUEUE_DEPTH) qd = IO_MAX_QUEUE_DEPTH;
+        ioBackend.queueDepth = (unsigned)qd;
+        return 2;
+    }
+    return 0;
+}
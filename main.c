@@ -1,6 +1,6 @@
 #include "dir_manage.h"
 
-int main() {
+int main(int argc, char *argv[]) {
     char path[512];
     int choice;
     char pattern[128];
@@ -10,6 +10,15 @@ int main() {
     // ---------------------------------------------------------
     initSyncMechanisms();
 
+    // ---------------------------------------------------------
+    // Non-interactive mode: dir_manage <command> ... | --batch FILE
+    // ---------------------------------------------------------
+    if (argc > 1) {
+        int rc = runCommandLine(argc - 1, argv + 1);
+        destroySyncMechanisms();
+        return rc;
+    }
+
     printf("Enter directory path: ");
     scanf("%s", path);
 
@@ -0,0 +1,326 @@
+// metrics.c
+// Hot-path instrumentation: per-thread counters and latency histograms
+// for each syscall class, merged on demand.
+//
+// Each thread records into its own MetricsBlock (no shared cache lines,
+// no locking on the hot path). Blocks are linked into a registry the
+// first time a thread records anything; metricsSnapshot() sums them.
+// When a thread exits its block stays registered (its counts still
+// belong in the totals) and is handed to the next new thread.
+#include "dir_manage.h"
+
+int metricsEnabled = 0;
+
+typedef struct MetricsBlock {
+    unsigned long long count[MET_NUM_CLASSES];
+    unsigned long long totalNs[MET_NUM_CLASSES];
+    unsigned long long buckets[MET_NUM_CLASSES][MET_NUM_BUCKETS];
+    unsigned long long bytesRead;
+    unsigned long long bytesWritten;
+    struct MetricsBlock *next;
+    struct MetricsBlock *nextFree;  // on the free list: owner thread exited
+} MetricsBlock;
+
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+static MetricsBlock *registry = NULL;
+static MetricsBlock *freeBlocks = NULL;
+static __thread MetricsBlock *threadBlock = NULL;
+static pthread_key_t blockKey;
+static pthread_once_t blockKeyOnce = PTHREAD_ONCE_INIT;
+
+static const char *classNames[MET_NUM_CLASSES] = {
+    "opendir", "readdir", "stat", "name_lookup", "open",
+    "read", "write", "unlink", "format", "lock_wait",
+    "throttle_wait"
+};
+
+const char *metricsClassName(MetricClass cls) {
+    return (cls >= 0 && cls < MET_NUM_CLASSES) ? classNames[cls] : "?";
+}
+
+// ===============================================================
+// RECORDING
+// ===============================================================
+static void releaseBlock(void *arg) {
+    MetricsBlock *b = arg;
+    pthread_mutex_lock(&registryLock);
+    b->nextFree = freeBlocks;
+    freeBlocks = b;
+    pthread_mutex_unlock(&registryLock);
+}
+
+static void makeBlockKey(void) {
+    pthread_key_create(&blockKey, releaseBlock);
+}
+
+static MetricsBlock *getThreadBlock(void) {
+    if (threadBlock) return threadBlock;
+
+    pthread_once(&blockKeyOnce, makeBlockKey);
+
+    pthread_mutex_lock(&registryLock);
+    MetricsBlock *b = freeBlocks;
+    if (b) {
+        freeBlocks = b->nextFree;
+    } else if ((b = calloc(1, sizeof(MetricsBlock))) != NULL) {
+        b->next = registry;
+        registry = b;
+    }
+    pthread_mutex_unlock(&registryLock);
+    if (!b) return NULL;
+
+    pthread_setspecific(blockKey, b);
+    threadBlock = b;
+    return b;
+}
+
+unsigned long long metricsNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+// Bucket i holds latencies in (2^(i+MET_BUCKET_SHIFT-1), 2^(i+MET_BUCKET_SHIFT)] ns,
+// matching Prometheus' le= upper bounds; bucket 0 also takes everything
+// faster, the last one everything slower.
+static int bucketFor(unsigned long long ns) {
+    if (ns <= 1) return 0;
+    int b = 64 - __builtin_clzll(ns - 1) - MET_BUCKET_SHIFT;
+    if (b < 0) return 0;
+    if (b >= MET_NUM_BUCKETS) return MET_NUM_BUCKETS - 1;
+    return b;
+}
+
+void metricsRecord(MetricClass cls, unsigned long long startNs) {
+    MetricsBlock *b = getThreadBlock();
+    if (!b) return;
+
+    unsigned long long ns = metricsNow() - startNs;
+    b->count[cls]++;
+    b->totalNs[cls] += ns;
+    b->buckets[cls][bucketFor(ns)]++;
+}
+
+void metricsAddBytes(unsigned long long nread, unsigned long long nwritten) {
+    if (!metricsEnabled) return;
+    MetricsBlock *b = getThreadBlock();
+    if (!b) return;
+    b->bytesRead += nread;
+    b->bytesWritten += nwritten;
+}
+
+// ===============================================================
+// MERGE / RESET
+// ===============================================================
+void metricsSnapshot(MetricsSummary *out) {
+    memset(out, 0, sizeof(*out));
+
+    pthread_mutex_lock(&registryLock);
+    for (MetricsBlock *b = registry; b; b = b->next) {
+        for (int c = 0; c < MET_NUM_CLASSES; c++) {
+            out->count[c] += b->count[c];
+            out->totalNs[c] += b->totalNs[c];
+            for (int k = 0; k < MET_NUM_BUCKETS; k++)
+                out->buckets[c][k] += b->buckets[c][k];
+        }
+        out->bytesRead += b->bytesRead;
+        out->bytesWritten += b->bytesWritten;
+    }
+    pthread_mutex_unlock(&registryLock);
+}
+
+// Call between operations, not while other threads are recording.
+void metricsReset(void) {
+    pthread_mutex_lock(&registryLock);
+    for (MetricsBlock *b = registry; b; b = b->next) {
+        MetricsBlock *next = b->next, *nextFree = b->nextFree;
+        memset(b, 0, sizeof(*b));
+        b->next = next;
+        b->nextFree = nextFree;
+    }
+    pthread_mutex_unlock(&registryLock);
+}
+
+// ===============================================================
+// OUTPUT
+// ===============================================================
+static unsigned long long bucketUpperNs(int k) {
+    return 1ULL << (k + MET_BUCKET_SHIFT);
+}
+
+// Approximate percentile: upper bound of the bucket containing it
+static unsigned long long percentileNs(const MetricsSummary *m, int cls, double p) {
+    unsigned long long target = (unsigned long long)(m->count[cls] * p);
+    unsigned long long seen = 0;
+    for (int k = 0; k < MET_NUM_BUCKETS; k++) {
+        seen += m->buckets[cls][k];
+        if (seen > target) return bucketUpperNs(k);
+    }
+    return bucketUpperNs(MET_NUM_BUCKETS - 1);
+}
+
+void printMetricsSummary(FILE *fp) {
+    MetricsSummary m;
+    metricsSnapshot(&m);
+
+    fprintf(fp, "------------------------- Metrics -------------------------\n");
+    fprintf(fp, "%-12s %10s %12s %10s %10s %10s\n",
+            "class", "count", "total(ms)", "avg(us)", "p50(us)", "p99(us)");
+    for (int c = 0; c < MET_NUM_CLASSES; c++) {
+        if (m.count[c] == 0) continue;
+        fprintf(fp, "%-12s %10llu %12.3f %10.2f %10.2f %10.2f\n",
+                classNames[c],
+                (unsigned long long)m.count[c],
+                m.totalNs[c] / 1e6,
+                m.totalNs[c] / 1e3 / m.count[c],
+                percentileNs(&m, c, 0.50) / 1e3,
+                percentileNs(&m, c, 0.99) / 1e3);
+    }
+    fprintf(fp, "bytes read: %llu, bytes written: %llu\n",
+            (unsigned long long)m.bytesRead, (unsigned long long)m.bytesWritten);
+    fprintf(fp, "-----------------------------------------------------------\n");
+}
+
+// Prometheus text exposition format (one scrape-able file)
+int exportMetricsPrometheus(const char *outfile) {
+    MetricsSummary m;
+    metricsSnapshot(&m);
+
+    FILE *fp = fopen(outfile, "w");
+    if (!fp) {
+        perror("Unable to create metrics file");
+        return -1;
+    }
+
+    fprintf(fp, "# HELP dir_manage_op_duration_seconds Latency of instrumented calls by class.\n");
+    fprintf(fp, "# TYPE dir_manage_op_duration_seconds histogram\n");
+    for (int c = 0; c < MET_NUM_CLASSES; c++) {
+        unsigned long long cumulative = 0;
+        for (int k = 0; k < MET_NUM_BUCKETS - 1; k++) {
+            cumulative += m.buckets[c][k];
+            fprintf(fp, "dir_manage_op_duration_seconds_bucket{class=\"%s\",le=\"%.9g\"} %llu\n",
+                    classNames[c], bucketUpperNs(k) / 1e9, (unsigned long long)cumulative);
+        }
+        fprintf(fp, "dir_manage_op_duration_seconds_bucket{class=\"%s\",le=\"+Inf\"} %llu\n",
+                classNames[c], (unsigned long long)m.count[c]);
+        fprintf(fp, "dir_manage_op_duration_seconds_sum{class=\"%s\"} %.9f\n",
+                classNames[c], m.totalNs[c] / 1e9);
+        fprintf(fp, "dir_manage_op_duration_seconds_count{class=\"%s\"} %llu\n",
+                classNames[c], (unsigned long long)m.count[c]);
+    }
+
+    fprintf(fp, "# HELP dir_manage_read_bytes_total Bytes read from files.\n");
+    fprintf(fp, "# TYPE dir_manage_read_bytes_total counter\n");
+    fprintf(fp, "dir_manage_read_bytes_total %llu\n", (unsigned long long)m.bytesRead);
+    fprintf(fp, "# HELP dir_manage_written_bytes_total Bytes written to files.\n");
+    fprintf(fp, "# TYPE dir_manage_written_bytes_total counter\n");
+    fprintf(fp, "dir_manage_written_bytes_total %llu\n", (unsigned long long)m.bytesWritten);
+
+    fclose(fp);
+    return 0;
+}
+
+// ===============================================================
+// INSTRUMENTED CALL WRAPPERS
+// ===============================================================
+#ifndef DIR_MANAGE_NO_METRICS
+
+DIR *metOpendir(const char *path) {
+    if (!metricsEnabled) return opendir(path);
+    unsigned long long t = metricsNow();
+    DIR *d = opendir(path);
+    metricsRecord(MET_OPENDIR, t);
+    return d;
+}
+
+struct dirent *metReaddir(DIR *dir) {
+    if (!metricsEnabled) return readdir(dir);
+    unsigned long long t = metricsNow();
+    struct dirent *de = readdir(dir);
+    metricsRecord(MET_READDIR, t);
+    return de;
+}
+
+int metStat(const char *path, struct stat *st) {
+    if (!metricsEnabled) return stat(path, st);
+    unsigned long long t = metricsNow();
+    int rc = stat(path, st);
+    metricsRecord(MET_STAT, t);
+    return rc;
+}
+
+int metLstat(const char *path, struct stat *st) {
+    if (!metricsEnabled) return lstat(path, st);
+    unsigned long long t = metricsNow();
+    int rc = lstat(path, st);
+    metricsRecord(MET_STAT, t);
+    return rc;
+}
+
+struct passwd *metGetpwuid(uid_t uid) {
+    if (!metricsEnabled) return getpwuid(uid);
+    unsigned long long t = metricsNow();
+    struct passwd *pw = getpwuid(uid);
+    metricsRecord(MET_NAME_LOOKUP, t);
+    return pw;
+}
+
+struct group *metGetgrgid(gid_t gid) {
+    if (!metricsEnabled) return getgrgid(gid);
+    unsigned long long t = metricsNow();
+    struct group *gr = getgrgid(gid);
+    metricsRecord(MET_NAME_LOOKUP, t);
+    return gr;
+}
+
+int metOpen(const char *path, int flags, mode_t mode) {
+    if (!metricsEnabled) return open(path, flags, mode);
+    unsigned long long t = metricsNow();
+    int fd = open(path, flags, mode);
+    metricsRecord(MET_OPEN, t);
+    return fd;
+}
+
+ssize_t metRead(int fd, void *buf, size_t len) {
+    if (!metricsEnabled) return read(fd, buf, len);
+    unsigned long long t = metricsNow();
+    ssize_t n = read(fd, buf, len);
+    metricsRecord(MET_READ, t);
+    if (n > 0) metricsAddBytes((unsigned long long)n, 0);
+    return n;
+}
+
+ssize_t metWrite(int fd, const void *buf, size_t len) {
+    if (!metricsEnabled) return write(fd, buf, len);
+    unsigned long long t = metricsNow();
+    ssize_t n = write(fd, buf, len);
+    metricsRecord(MET_WRITE, t);
+    if (n > 0) metricsAddBytes(0, (unsigned long long)n);
+    return n;
+}
+
+int metRemove(const char *path) {
+    if (!metricsEnabled) return remove(path);
+    unsigned long long t = metricsNow();
+    int rc = remove(path);
+    metricsRecord(MET_UNLINK, t);
+    return rc;
+}
+
+int metUnlink(const char *path) {
+    if (!metricsEnabled) return unlink(path);
+    unsigned long long t = metricsNow();
+    int rc = unlink(path);
+    metricsRecord(MET_UNLINK, t);
+    return rc;
+}
+
+int metRmdir(const char *path) {
+    if (!metricsEnabled) return rmdir(path);
+    unsigned long long t = metricsNow();
+    int rc = rmdir(path);
+    metricsRecord(MET_UNLINK, t);
+    return rc;
+}
+
+#endif
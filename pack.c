@@ -0,0 +1,507 @@
+// pack.c
+// Append-only pack archive for cold small files.
+//
+// Layout (all integers little endian):
+//   header   "DMPACK\0\1"
+//   data     file contents, back to back
+//   index    per entry: offset u64, size u64, mtime i64, mode u32,
+//            crc32c u32, nameLen u32 (incl. NUL), name
+//   footer   "DMPKFTR1", indexOffset u64, indexSize u64,
+//            count u32, crc32c(index) u32
+//
+// Appending never rewrites existing bytes: new data and a complete new
+// index (old + new entries, sorted by name, last copy of a name wins)
+// go after the old footer. A failed append is cut back to the old size.
+// A crash mid-append can still leave bytes with no footer after them,
+// so readers use the last footer whose index checksum is valid, and the
+// next append truncates the torn tail away.
+#include "dir_manage.h"
+#include <errno.h>
+
+#define PACK_MAGIC         "DMPACK\0\1"
+#define PACK_FOOTER_MAGIC  "DMPKFTR1"
+#define PACK_HEADER_SIZE   8
+#define PACK_FOOTER_SIZE   32
+#define PACK_ENTRY_FIXED   36      // index entry bytes before the name
+#define PACK_BUFFER_SIZE   (1 << 20)
+
+struct Pack {
+    int fd;
+    int writable;
+    off_t committedSize;    // file size at open / last commit
+    off_t end;              // where the next data goes
+    dev_t dev;
+    ino_t ino;
+    PackEntry *entries;
+    int count;
+    int cap;
+    int sorted;             // entries sorted by name, no duplicates
+    char *buf;              // write buffer for data
+    size_t bufLen;
+};
+
+// ===============================================================
+// ENCODING HELPERS
+// ===============================================================
+static void putLE(unsigned char *p, unsigned long long v, int bytes) {
+    for (int i = 0; i < bytes; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static unsigned long long getLE(const unsigned char *p, int bytes) {
+    unsigned long long v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static int writeAll(int fd, const void *data, size_t len, off_t off) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        off += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int readAll(int fd, void *data, size_t len, off_t off) {
+    char *p = data;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) { errno = EIO; return -1; }     // truncated pack
+        p += n;
+        off += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int flushBuffer(Pack *p) {
+    if (p->bufLen == 0) return 0;
+    if (writeAll(p->fd, p->buf, p->bufLen, p->end - (off_t)p->bufLen) != 0) return -1;
+    metricsAddBytes(0, p->bufLen);
+    p->bufLen = 0;
+    return 0;
+}
+
+static int compareEntryName(const void *a, const void *b) {
+    const PackEntry *e1 = a, *e2 = b;
+    int c = strcmp(e1->name, e2->name);
+    if (c) return c;
+    return e1->offset < e2->offset ? -1 : e1->offset > e2->offset;
+}
+
+// Sort by name and drop superseded copies (older offset of the same name)
+static void sortEntries(Pack *p) {
+    int out = 0;
+
+    if (p->sorted) return;
+    qsort(p->entries, p->count, sizeof(PackEntry), compareEntryName);
+    for (int i = 0; i < p->count; i++) {
+        if (i + 1 < p->count && strcmp(p->entries[i].name, p->entries[i + 1].name) == 0) {
+            free(p->entries[i].name);
+            continue;
+        }
+        p->entries[out++] = p->entries[i];
+    }
+    p->count = out;
+    p->sorted = 1;
+}
+
+static PackEntry *newEntry(Pack *p) {
+    if (p->count == p->cap) {
+        int newCap = p->cap ? p->cap * 2 : 256;
+        PackEntry *grown = realloc(p->entries, sizeof(PackEntry) * newCap);
+        if (!grown) return NULL;
+        p->entries = grown;
+        p->cap = newCap;
+    }
+    return &p->entries[p->count];
+}
+
+// ===============================================================
+// OPEN / LOAD INDEX
+// ===============================================================
+// Load the index described by the footer at footerPos. Returns -1
+// (with nothing loaded) if that footer or its index is not valid.
+static int loadIndexAt(Pack *p, off_t footerPos) {
+    unsigned char footer[PACK_FOOTER_SIZE];
+
+    if (footerPos < PACK_HEADER_SIZE ||
+        readAll(p->fd, footer, sizeof(footer), footerPos) != 0 ||
+        memcmp(footer, PACK_FOOTER_MAGIC, 8) != 0)
+        return -1;
+
+    off_t indexOffset = (off_t)getLE(footer + 8, 8);
+    size_t indexSize = (size_t)getLE(footer + 16, 8);
+    int count = (int)getLE(footer + 24, 4);
+    uint32_t indexCrc = (uint32_t)getLE(footer + 28, 4);
+
+    if (indexOffset < PACK_HEADER_SIZE || indexOffset > footerPos ||
+        indexOffset + (off_t)indexSize != footerPos)
+        return -1;
+
+    unsigned char *index = malloc(indexSize ? indexSize : 1);
+    if (!index) return -1;
+    if (readAll(p->fd, index, indexSize, indexOffset) != 0 ||
+        crc32cUpdate(0, index, indexSize) != indexCrc)
+        goto bad;
+
+    size_t pos = 0;
+    for (int i = 0; i < count; i++) {
+        PackEntry *e = newEntry(p);
+        if (!e || pos + PACK_ENTRY_FIXED > indexSize) goto bad;
+
+        const unsigned char *r = index + pos;
+        size_t nameLen = (size_t)getLE(r + 32, 4);
+        if (nameLen == 0 || pos + PACK_ENTRY_FIXED + nameLen > indexSize ||
+            r[PACK_ENTRY_FIXED + nameLen - 1] != '\0')
+            goto bad;
+
+        e->offset = (off_t)getLE(r, 8);
+        e->size = (off_t)getLE(r + 8, 8);
+        e->mtime = (time_t)(long long)getLE(r + 16, 8);
+        e->mode = (mode_t)getLE(r + 24, 4);
+        e->crc = (uint32_t)getLE(r + 28, 4);
+        e->name = strdup((const char *)r + PACK_ENTRY_FIXED);
+        if (!e->name || e->offset + e->size > indexOffset) {
+            free(e->name);
+            goto bad;
+        }
+        p->count++;
+        pos += PACK_ENTRY_FIXED + nameLen;
+    }
+
+    free(index);
+    p->sorted = 1;      // written sorted by packCommit()
+    p->end = footerPos + PACK_FOOTER_SIZE;
+    return 0;
+
+bad:
+    free(index);
+    for (int i = 0; i < p->count; i++) free(p->entries[i].name);
+    p->count = 0;
+    return -1;
+}
+
+// Find the last complete commit. Normally that is the footer at the very
+// end; after a torn append it is an earlier one, found by scanning back
+// for the footer magic.
+static int loadIndex(Pack *p, off_t size) {
+    enum { BLOCK = 65536, OVERLAP = 7 };
+    unsigned char *buf;
+
+    if (size >= PACK_HEADER_SIZE + PACK_FOOTER_SIZE &&
+        loadIndexAt(p, size - PACK_FOOTER_SIZE) == 0)
+        return 0;
+
+    if (!(buf = malloc(BLOCK + OVERLAP))) return -1;
+
+    // Candidate footer starts lie in [blockStart, blockEnd); reading 7
+    // bytes past blockEnd catches a magic split across two blocks
+    for (off_t blockEnd = size - PACK_FOOTER_SIZE + 1; blockEnd > PACK_HEADER_SIZE; ) {
+        off_t blockStart = blockEnd - BLOCK > PACK_HEADER_SIZE ? blockEnd - BLOCK : PACK_HEADER_SIZE;
+        size_t len = (size_t)(blockEnd - blockStart) + OVERLAP;
+
+        if (readAll(p->fd, buf, len, blockStart) != 0) break;
+        for (size_t i = (size_t)(blockEnd - blockStart); i-- > 0; ) {
+            if (memcmp(buf + i, PACK_FOOTER_MAGIC, 8) == 0 &&
+                loadIndexAt(p, blockStart + (off_t)i) == 0) {
+                free(buf);
+                fprintf(stderr, "pack: ignoring %lld bytes after the last complete commit\n",
+                        (long long)(size - p->end));
+                return 0;
+            }
+        }
+        blockEnd = blockStart;
+    }
+
+    free(buf);
+    fprintf(stderr, "pack: no complete commit found\n");
+    errno = EINVAL;
+    return -1;
+}
+
+// Open an existing pack for reading, or (forWrite) create/append.
+Pack *packOpen(const char *path, int forWrite) {
+    struct stat st;
+    Pack *p = calloc(1, sizeof(Pack));
+    if (!p) return NULL;
+
+    p->writable = forWrite;
+    p->fd = metOpen(path, forWrite ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (p->fd < 0 || fstat(p->fd, &st) != 0) {
+        perror(path);
+        packClose(p);
+        return NULL;
+    }
+    p->dev = st.st_dev;
+    p->ino = st.st_ino;
+    p->committedSize = st.st_size;
+
+    if (forWrite && st.st_size == 0) {
+        // Fresh pack: just the header, committed with the first index
+        p->end = PACK_HEADER_SIZE;
+        p->sorted = 1;
+        if (writeAll(p->fd, PACK_MAGIC, PACK_HEADER_SIZE, 0) != 0) {
+            perror(path);
+            packClose(p);
+            return NULL;
+        }
+    } else {
+        char magic[PACK_HEADER_SIZE];
+        if (readAll(p->fd, magic, sizeof(magic), 0) != 0 ||
+            memcmp(magic, PACK_MAGIC, PACK_HEADER_SIZE) != 0) {
+            fprintf(stderr, "%s: not a pack file\n", path);
+            packClose(p);
+            return NULL;
+        }
+        if (loadIndex(p, st.st_size) != 0) {
+            packClose(p);
+            return NULL;
+        }
+        // Cut off a torn append before adding to the pack
+        if (forWrite && p->end < st.st_size) {
+            if (ftruncate(p->fd, p->end) != 0) {
+                perror(path);
+                packClose(p);
+                return NULL;
+            }
+            p->committedSize = p->end;
+        }
+    }
+
+    if (forWrite && !(p->buf = malloc(PACK_BUFFER_SIZE))) {
+        packClose(p);
+        return NULL;
+    }
+    return p;
+}
+
+// True if st is the pack file itself (so a walk does not pack its output)
+int packIsSelf(const Pack *p, const struct stat *st) {
+    return st->st_dev == p->dev && st->st_ino == p->ino;
+}
+
+// ===============================================================
+// APPEND / COMMIT
+// ===============================================================
+
+// Append one file's data under 'name'. The entry becomes visible to
+// readers only after packCommit().
+int packAppendFile(Pack *p, const char *srcPath, const char *name, const struct stat *st) {
+    PackEntry *e = newEntry(p);
+    if (!e) return -1;
+
+    int fd = metOpen(srcPath, O_RDONLY, 0);
+    if (fd < 0) {
+        perror(srcPath);
+        return -1;
+    }
+
+    throttleAcquire(1, (unsigned long long)st->st_size);
+
+    off_t start = p->end;
+    uint32_t crc = 0;
+    ssize_t n;
+    for (;;) {
+        if (p->bufLen == PACK_BUFFER_SIZE && flushBuffer(p) != 0) {
+            perror("pack write");
+            close(fd);
+            return -1;
+        }
+        n = metRead(fd, p->buf + p->bufLen, PACK_BUFFER_SIZE - p->bufLen);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        crc = crc32cUpdate(crc, p->buf + p->bufLen, (size_t)n);
+        p->bufLen += (size_t)n;
+        p->end += n;
+    }
+    close(fd);
+
+    if (n < 0) {
+        perror(srcPath);
+        // Drop what was buffered for this file; flushed bytes are
+        // overwritten by the next file or cut off by packClose()
+        size_t drop = (size_t)(p->end - start) < p->bufLen ? (size_t)(p->end - start) : p->bufLen;
+        p->bufLen -= drop;
+        p->end = start;
+        return -1;
+    }
+
+    e->name = strdup(name);
+    if (!e->name) return -1;
+    e->offset = start;
+    e->size = p->end - start;
+    e->mtime = st->st_mtime;
+    e->mode = st->st_mode & 07777;
+    e->crc = crc;
+    p->count++;
+    p->sorted = 0;
+    return 0;
+}
+
+// Write the new index and footer and make everything durable.
+int packCommit(Pack *p) {
+    size_t indexSize = 0;
+
+    if (flushBuffer(p) != 0) {
+        perror("pack write");
+        return -1;
+    }
+    sortEntries(p);
+
+    for (int i = 0; i < p->count; i++)
+        indexSize += PACK_ENTRY_FIXED + strlen(p->entries[i].name) + 1;
+
+    unsigned char *index = malloc(indexSize + PACK_FOOTER_SIZE);
+    if (!index) return -1;
+
+    unsigned char *w = index;
+    for (int i = 0; i < p->count; i++) {
+        const PackEntry *e = &p->entries[i];
+        size_t nameLen = strlen(e->name) + 1;
+        putLE(w, (unsigned long long)e->offset, 8);
+        putLE(w + 8, (unsigned long long)e->size, 8);
+        putLE(w + 16, (unsigned long long)(long long)e->mtime, 8);
+        putLE(w + 24, e->mode, 4);
+        putLE(w + 28, e->crc, 4);
+        putLE(w + 32, nameLen, 4);
+        memcpy(w + PACK_ENTRY_FIXED, e->name, nameLen);
+        w += PACK_ENTRY_FIXED + nameLen;
+    }
+
+    memcpy(w, PACK_FOOTER_MAGIC, 8);
+    putLE(w + 8, (unsigned long long)p->end, 8);
+    putLE(w + 16, indexSize, 8);
+    putLE(w + 24, (unsigned long long)p->count, 4);
+    putLE(w + 28, crc32cUpdate(0, index, indexSize), 4);
+
+    int rc = writeAll(p->fd, index, indexSize + PACK_FOOTER_SIZE, p->end);
+    free(index);
+    if (rc != 0 || fdatasync(p->fd) != 0) {
+        perror("pack commit");
+        return -1;
+    }
+
+    p->end += (off_t)(indexSize + PACK_FOOTER_SIZE);
+    p->committedSize = p->end;
+    return 0;
+}
+
+// Close the pack. Appended but uncommitted data is cut off again.
+void packClose(Pack *p) {
+    if (!p) return;
+    if (p->fd >= 0) {
+        if (p->writable && p->end != p->committedSize && ftruncate(p->fd, p->committedSize) != 0)
+            perror("pack rollback");
+        close(p->fd);
+    }
+    for (int i = 0; i < p->count; i++) free(p->entries[i].name);
+    free(p->entries);
+    free(p->buf);
+    free(p);
+}
+
+// ===============================================================
+// LOOKUP / EXTRACT
+// ===============================================================
+int packEntryCount(const Pack *p) {
+    return p->count;
+}
+
+const PackEntry *packEntryAt(const Pack *p, int i) {
+    return (i >= 0 && i < p->count) ? &p->entries[i] : NULL;
+}
+
+// Binary search in the (committed, sorted) index
+const PackEntry *packFind(const Pack *p, const char *name) {
+    if (!p->sorted) return NULL;
+
+    int lo = 0, hi = p->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int c = strcmp(p->entries[mid].name, name);
+        if (c == 0) return &p->entries[mid];
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+// Reject names that would escape the destination directory
+static int safeEntryName(const char *name) {
+    if (name[0] == '/' || name[0] == '\0') return 0;
+    for (const char *c = name; c; c = strchr(c, '/')) {
+        if (*c == '/') c++;
+        if (strncmp(c, "..", 2) == 0 && (c[2] == '/' || c[2] == '\0')) return 0;
+    }
+    return 1;
+}
+
+static int makeParents(char *path) {
+    for (char *s = strchr(path + 1, '/'); s; s = strchr(s + 1, '/')) {
+        *s = '\0';
+        int rc = mkdir(path, 0755);
+        *s = '/';
+        if (rc != 0 && errno != EEXIST) return -1;
+    }
+    return 0;
+}
+
+// Extract one entry below destDir (random access through its offset),
+// restoring mode and mtime. The data must match its recorded CRC32C.
+int packExtract(Pack *p, const PackEntry *e, const char *destDir) {
+    char path[PATH_MAX], buf[65536];
+    uint32_t crc = 0;
+
+    if (!safeEntryName(e->name)) {
+        fprintf(stderr, "pack: refusing unsafe name %s\n", e->name);
+        errno = EINVAL;
+        return -1;
+    }
+    if (snprintf(path, sizeof(path), "%s/%s", destDir, e->name) >= (int)sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (makeParents(path) != 0) {
+        perror(path);
+        return -1;
+    }
+
+    int fd = metOpen(path, O_WRONLY | O_CREAT | O_TRUNC, e->mode & 0777);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    for (off_t done = 0; done < e->size; ) {
+        size_t want = e->size - done < (off_t)sizeof(buf) ? (size_t)(e->size - done) : sizeof(buf);
+        if (readAll(p->fd, buf, want, e->offset + done) != 0 || writeAll(fd, buf, want, done) != 0) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+        crc = crc32cUpdate(crc, buf, want);
+        metricsAddBytes(want, want);
+        done += (off_t)want;
+    }
+
+    if (crc != e->crc) {
+        fprintf(stderr, "pack: %s: checksum mismatch\n", e->name);
+        close(fd);
+        metUnlink(path);
+        errno = EIO;
+        return -1;
+    }
+
+    struct timespec times[2] = { { 0, UTIME_OMIT }, { e->mtime, 0 } };
+    futimens(fd, times);
+    fchmod(fd, e->mode & 07777);
+    close(fd);
+    return 0;
+}
@@ -3,81 +3,100 @@
 
 #define MAX_FILES 20000
 
+// Fill one FileInfo from a stat result. 'name' is stored truncated to fit.
+void fillFileInfo(FileInfo *fi, const char *name, const struct stat *st) {
+    snprintf(fi->name, sizeof(fi->name), "%s", name);
+    fi->size = st->st_size;
+    fi->allocated = (off_t)st->st_blocks * 512;
+
+    struct passwd *pw = metGetpwuid(st->st_uid);
+    struct group  *gr = metGetgrgid(st->st_gid);
+    snprintf(fi->owner, sizeof(fi->owner), "%s", pw ? pw->pw_name : "unknown");
+    snprintf(fi->group, sizeof(fi->group), "%s", gr ? gr->gr_name : "unknown");
+
+    fi->modified = st->st_mtime;
+}
+
 // Helper: recursively collect files under 'path' into files[] (up to max_files).
-// Returns number of files collected.
-static int collectFilesRecursive(const char *path, FileInfo files[], int max_files, int *index) {
-    struct dirent *de;
-    struct stat st;
-    char fullPath[1024];
-
-    DIR *dr = opendir(path);
-    if (!dr) {
+// Directories already visited (symlink cycles) are skipped and each
+// file is collected once, however many links lead to it. viaLink: path
+// was reached through a directory symlink. Returns number of files collected.
+static int collectFilesRecursive(TraversalState *ts, const char *path, int viaLink,
+                                 FileInfo files[], int max_files, int *index) {
+    DirListing dl;
+    char fullPath[PATH_MAX];
+
+    if (readDirListing(path, traversalPolicy.followSymlinks, &dl) != 0) {
         // perror("Unable to open directory (collectFilesRecursive)");
         return *index;
     }
 
-    while ((de = readdir(dr)) != NULL) {
-        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
-            continue;
+    for (int i = 0; i < dl.count; i++) {
+        struct stat *st = &dl.st[i];
 
-        snprintf(fullPath, sizeof(fullPath), "%s/%s", path, de->d_name);
+        if (dl.err[i] != 0)
+            continue;
 
-        if (stat(fullPath, &st) != 0)
+        if (snprintf(fullPath, sizeof(fullPath), "%s/%s", path, dl.names[i]) >= (int)sizeof(fullPath))
             continue;
 
-        if (S_ISDIR(st.st_mode)) {
-            // recurse into subdirectory
-            collectFilesRecursive(fullPath, files, max_files, index);
-        } else if (S_ISREG(st.st_mode)) {
-            if (*index >= max_files) {
-                closedir(dr);
-                return *index;
-            }
-            // fill FileInfo
-            strncpy(files[*index].name, fullPath, sizeof(files[*index].name)-1);
-            files[*index].name[sizeof(files[*index].name)-1] = '\0';
-            files[*index].size = st.st_size;
-
-            struct passwd *pw = getpwuid(st.st_uid);
-            struct group  *gr = getgrgid(st.st_gid);
-            strncpy(files[*index].owner, pw ? pw->pw_name : "unknown", sizeof(files[*index].owner)-1);
-            files[*index].owner[sizeof(files[*index].owner)-1] = '\0';
-            strncpy(files[*index].group, gr ? gr->gr_name : "unknown", sizeof(files[*index].group)-1);
-            files[*index].group[sizeof(files[*index].group)-1] = '\0';
-
-            files[*index].modified = st.st_mtime;
+        int linked = viaLink || dl.isLink[i];
+
+        if (S_ISDIR(st->st_mode)) {
+            // recurse into subdirectory (once per inode, same fs with -xdev)
+            if (traversalEnterDir(ts, st, linked))
+                collectFilesRecursive(ts, fullPath, linked, files, max_files, index);
+        } else if (S_ISREG(st->st_mode)) {
+            if (*index >= max_files)
+                break;
+            if (!traversalFirstVisit(ts, st, linked))
+                continue;
+            fillFileInfo(&files[*index], fullPath, st);
             (*index)++;
         }
     }
 
-    closedir(dr);
+    freeDirListing(&dl);
     return *index;
 }
 
-// Public: export TXT report (human readable)
-void exportReportTXT(const char *path, const char *outfile) {
-    FileInfo *files = malloc(sizeof(FileInfo) * MAX_FILES);
-    if (!files) {
-        fprintf(stderr, "Memory allocation failed for files array\n");
-        return;
-    }
+static int collectReportFiles(const char *path, FileInfo files[], int max_files) {
+    TraversalState ts;
     int count = 0;
-    collectFilesRecursive(path, files, MAX_FILES, &count);
 
+    if (traversalStart(&ts, path) != 0) {
+        perror("Unable to open directory");
+        return 0;
+    }
+    collectFilesRecursive(&ts, path, 0, files, max_files, &count);
+    traversalEnd(&ts);
+    return count;
+}
+
+// Public: write an already collected file list as a TXT report.
+// Returns 0 on success, -1 if the file could not be created.
+int writeReportTXT(const char *path, const FileInfo files[], int count, const char *outfile) {
     lockFileOps();
     FILE *fp = fopen(outfile, "w");
     if (!fp) {
         perror("Unable to create TXT report");
         unlockFileOps();
-        free(files);
-        return;
+        return -1;
     }
 
+    METRIC_START(t);
     fprintf(fp, "Directory Snapshot Report for: %s\n", path);
     fprintf(fp, "Generated on: %s", ctime(&(time_t){time(NULL)}));
-    fprintf(fp, "Total files: %d\n", count);
+    long long apparent = 0, allocated = 0;
+    for (int i = 0; i < count; i++) {
+        apparent += files[i].size;
+        allocated += files[i].allocated;
+    }
+
+    fprintf(fp, "Total files: %d (hardlinks counted once)\n", count);
+    fprintf(fp, "Total size: %lld bytes apparent, %lld bytes allocated\n", apparent, allocated);
     fprintf(fp, "--------------------------------------------------------------------------------\n");
-    fprintf(fp, "%-6s %-80s %-12s %-12s %-24s\n", "Index", "Path", "Size(B)", "Owner", "Last Modified");
+    fprintf(fp, "%-6s %-80s %-12s %-12s %-12s %-24s\n", "Index", "Path", "Size(B)", "Alloc(B)", "Owner", "Last Modified");
     fprintf(fp, "--------------------------------------------------------------------------------\n");
 
     for (int i = 0; i < count; i++) {
@@ -86,63 +105,87 @@ void exportReportTXT(const char *path, const char *outfile) {
         localtime_r(&files[i].modified, &tm);
         strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", &tm);
 
-        fprintf(fp, "%-6d %-80s %-12ld %-12s %-24s\n",
+        fprintf(fp, "%-6d %-80s %-12ld %-12ld %-12s %-24s\n",
                 i + 1,
                 files[i].name,
                 (long)files[i].size,
+                (long)files[i].allocated,
                 files[i].owner,
                 timestr);
     }
 
     fprintf(fp, "--------------------------------------------------------------------------------\n");
     fclose(fp);
+    METRIC_STOP(MET_FORMAT, t);
     unlockFileOps();
-
-    printf("TXT report generated: %s (files: %d)\n", outfile, count);
-    free(files);
+    return 0;
 }
 
-// Public: export CSV report (path, size, owner, group, modified_epoch)
-void exportReportCSV(const char *path, const char *outfile) {
+// Public: export TXT report (human readable)
+void exportReportTXT(const char *path, const char *outfile) {
     FileInfo *files = malloc(sizeof(FileInfo) * MAX_FILES);
     if (!files) {
         fprintf(stderr, "Memory allocation failed for files array\n");
         return;
     }
-    int count = 0;
-    collectFilesRecursive(path, files, MAX_FILES, &count);
+    int count = collectReportFiles(path, files, MAX_FILES);
+
+    if (writeReportTXT(path, files, count, outfile) == 0)
+        printf("TXT report generated: %s (files: %d)\n", outfile, count);
+    free(files);
+}
 
+// Public: write an already collected file list as a CSV report
+// (path, size, owner, group, modified_epoch, allocated).
+int writeReportCSV(const FileInfo files[], int count, const char *outfile) {
     lockFileOps();
     FILE *fp = fopen(outfile, "w");
     if (!fp) {
         perror("Unable to create CSV report");
         unlockFileOps();
-        free(files);
-        return;
+        return -1;
     }
 
+    METRIC_START(t);
+
     // CSV header
-    fprintf(fp, "path,size_bytes,owner,group,last_modified_epoch\n");
+    // allocated_bytes is last so existing consumers of the first five columns keep working
+    fprintf(fp, "path,size_bytes,owner,group,last_modified_epoch,allocated_bytes\n");
 
     for (int i = 0; i < count; i++) {
-        fprintf(fp, "\"%s\",%ld,%s,%s,%ld\n",
+        fprintf(fp, "\"%s\",%ld,%s,%s,%ld,%ld\n",
                 files[i].name,
                 (long)files[i].size,
                 files[i].owner,
                 files[i].group,
-                (long)files[i].modified);
+                (long)files[i].modified,
+                (long)files[i].allocated);
     }
 
     fclose(fp);
+    METRIC_STOP(MET_FORMAT, t);
     unlockFileOps();
+    return 0;
+}
 
-    printf("CSV report generated: %s (files: %d)\n", outfile, count);
+// Public: export CSV report (path, size, owner, group, modified_epoch, allocated)
+void exportReportCSV(const char *path, const char *outfile) {
+    FileInfo *files = malloc(sizeof(FileInfo) * MAX_FILES);
+    if (!files) {
+        fprintf(stderr, "Memory allocation failed for files array\n");
+        return;
+    }
+    int count = collectReportFiles(path, files, MAX_FILES);
+
+    if (writeReportCSV(files, count, outfile) == 0)
+        printf("CSV report generated: %s (files: %d)\n", outfile, count);
     free(files);
 }
 
 // Append a single SRU activity line to sru_log.txt (thread-safe).
 // Example logline format: "2025-10-13 12:34:56,DELETED,/path/to/file,12345,owner"
-void appendSRULog(const char *action, const char *filepath, long size, const char *owner) {
+static void writeSRULog(const char *action, const char *filepath, long size,
+                        const char *owner, const char *extra) {
     time_t now = time(NULL);
     char timestr[64];
     struct tm tm;
@@ -157,11 +200,23 @@ void appendSRULog(const char *action, const char *filepath, long size, const cha
         return;
     }
     // action could be "DELETED" or "SKIPPED" etc.
-    fprintf(fp, "%s,%s,%s,%ld,%s\n", timestr, action, filepath, size, owner);
+    fprintf(fp, "%s,%s,%s,%ld,%s%s\n", timestr, action, filepath, size, owner, extra);
     fclose(fp);
     unlockFileOps();
 }
 
+void appendSRULog(const char *action, const char *filepath, long size, const char *owner) {
+    writeSRULog(action, filepath, size, owner, "");
+}
+
+// Verified copies/moves add the data checksum as a sixth column
+void appendSRULogChecksum(const char *action, const char *filepath, long size,
+                          const char *owner, uint32_t crc) {
+    char extra[32];
+    snprintf(extra, sizeof(extra), ",crc32c:%08x", crc);
+    writeSRULog(action, filepath, size, owner, extra);
+}
+
 // Convenience wrapper: generate both txt and csv with default filenames
 void exportAllReports(const char *path) {
     exportReportTXT(path, "report.txt");
@@ -3,52 +3,62 @@
 // -------------------------------------------------------------
 // Recursive Search Function
 // -------------------------------------------------------------
-void searchByNameOrExtension(const char *path, const char *pattern) {
-    struct dirent *de;
-    char fullPath[1024];
+static void searchRecursive(TraversalState *ts, const char *path, int viaLink, const char *pattern) {
+    DirListing dl;
+    char fullPath[PATH_MAX];
 
-    DIR *dr = opendir(path);
-    if (!dr) {
+    if (readDirListing(path, traversalPolicy.followSymlinks, &dl) != 0) {
         perror("Unable to open directory");
         return;
     }
 
-    while ((de = readdir(dr)) != NULL) {
-        
-        // Skip "." and ".."
-        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
-            continue;
+    for (int i = 0; i < dl.count; i++) {
+        struct stat *st = &dl.st[i];
 
-        // Build full path
-        snprintf(fullPath, sizeof(fullPath), "%s/%s", path, de->d_name);
+        if (dl.err[i] != 0)
+            continue;
 
-        struct stat st;
-        if (stat(fullPath, &st) == 0) {
+        // Build full path (skip names that would not fit)
+        if (snprintf(fullPath, sizeof(fullPath), "%s/%s", path, dl.names[i]) >= (int)sizeof(fullPath))
+            continue;
 
-            // ---------------------------------------------
-            // If it is a directory → recursive call
-            // ---------------------------------------------
-            if (S_ISDIR(st.st_mode)) {
-                searchByNameOrExtension(fullPath, pattern);
-            } 
-            // ---------------------------------------------
-            // If it is a file → check match
-            // ---------------------------------------------
-            else if (S_ISREG(st.st_mode)) {
+        // ---------------------------------------------
+        // If it is a directory → recursive call
+        // (each directory inode once, honours -xdev)
+        // ---------------------------------------------
+        if (S_ISDIR(st->st_mode)) {
+            int linked = viaLink || dl.isLink[i];
+            if (traversalEnterDir(ts, st, linked))
+                searchRecursive(ts, fullPath, linked, pattern);
+        }
+        // ---------------------------------------------
+        // If it is a file → check match
+        // ---------------------------------------------
+        else if (S_ISREG(st->st_mode)) {
 
-                // If filename contains pattern (case-sensitive)
-                if (strstr(de->d_name, pattern) != NULL) {
+            // If filename contains pattern (case-sensitive)
+            if (strstr(dl.names[i], pattern) != NULL) {
 
-                    // Thread-safe output
-                    lockFileOps();
+                // Thread-safe output
+                lockFileOps();
 
-                    printf("Found: %s\n", fullPath);
+                printf("Found: %s\n", fullPath);
 
-                    unlockFileOps();
-                }
+                unlockFileOps();
             }
         }
     }
 
-    closedir(dr);
+    freeDirListing(&dl);
+}
+
+void searchByNameOrExtension(const char *path, const char *pattern) {
+    TraversalState ts;
+
+    if (traversalStart(&ts, path) != 0) {
+        perror("Unable to open directory");
+        return;
+    }
+    searchRecursive(&ts, path, 0, pattern);
+    traversalEnd(&ts);
 }
@@ -29,94 +29,274 @@ int compareByDate(const void *a, const void *b) {
 }
 
 // -----------------------------------------------------
-// Main Directory Listing + Sorting Function
+// Directory Snapshot (stable, read once)
 // -----------------------------------------------------
 
-void listAndSortDirectory(const char *path, int sortChoice) {
-    struct dirent *de;
-    struct stat st;
-    FileInfo files[1000];
-    int count = 0;
-    char fullPath[1024];
-
-    DIR *dr = opendir(path);
-    if (!dr) {
+#define LISTING_PAGE_SIZE 1000
+
+typedef struct SnapEntry {
+    FileInfo info;      // owner/group filled lazily when a page is fetched
+    uid_t uid;
+    gid_t gid;
+    int resolved;
+} SnapEntry;
+
+struct DirSnapshot {
+    SnapEntry *entries;
+    SnapEntry **order;   // order[0..sortedPrefix) is final, rest is unsorted
+    size_t count;
+    size_t capacity;
+    size_t sortedPrefix;
+    int (*compare)(const FileInfo *, const FileInfo *);
+};
+
+// Total orders used by the cursor: ties are broken by name, which is
+// unique inside one directory, so keyset pagination never skips rows.
+static int cursorByName(const FileInfo *a, const FileInfo *b) {
+    return strcmp(a->name, b->name);
+}
+
+static int cursorBySize(const FileInfo *a, const FileInfo *b) {
+    int c = compareBySize(a, b);
+    return c ? c : strcmp(a->name, b->name);
+}
+
+static int cursorByDate(const FileInfo *a, const FileInfo *b) {
+    int c = compareByDate(a, b);
+    return c ? c : strcmp(a->name, b->name);
+}
+
+// qsort() has no user-data argument, so the active comparator is kept
+// per thread while a snapshot is being sorted.
+static __thread int (*activeCompare)(const FileInfo *, const FileInfo *);
+
+static int compareEntryPtr(const void *a, const void *b) {
+    const SnapEntry *e1 = *(SnapEntry * const *)a;
+    const SnapEntry *e2 = *(SnapEntry * const *)b;
+    return activeCompare(&e1->info, &e2->info);
+}
+
+static void swapEntries(SnapEntry **a, size_t i, size_t j) {
+    SnapEntry *tmp = a[i];
+    a[i] = a[j];
+    a[j] = tmp;
+}
+
+// Partial selection: rearrange a[0..n) so the k smallest entries end up
+// in a[0..k) (in no particular order). Quickselect, median-of-three pivot.
+static void selectSmallest(SnapEntry **a, size_t n, size_t k,
+                           int (*cmp)(const FileInfo *, const FileInfo *)) {
+    size_t lo = 0, hi = n;
+
+    while (hi - lo > 1 && k > lo && k < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (cmp(&a[mid]->info, &a[lo]->info) < 0) swapEntries(a, mid, lo);
+        if (cmp(&a[hi - 1]->info, &a[lo]->info) < 0) swapEntries(a, hi - 1, lo);
+        if (cmp(&a[hi - 1]->info, &a[mid]->info) < 0) swapEntries(a, hi - 1, mid);
+
+        // Move pivot to the end and run a Lomuto partition
+        swapEntries(a, mid, hi - 1);
+        SnapEntry *pivot = a[hi - 1];
+        size_t store = lo;
+        for (size_t i = lo; i < hi - 1; i++) {
+            if (cmp(&a[i]->info, &pivot->info) < 0)
+                swapEntries(a, i, store++);
+        }
+        swapEntries(a, store, hi - 1);
+
+        if (store == k || store + 1 == k) return;
+        if (store > k) hi = store;
+        else lo = store + 1;
+    }
+}
+
+// Make sure order[0..upto) is in final sorted order.
+// The first request sorts only what it asks for. Once a caller pages
+// past that, the prefix at least doubles each time, so iterating to the
+// end costs O(n log n) overall instead of one selection per page.
+static void extendSortedPrefix(DirSnapshot *snap, size_t upto) {
+    if (upto <= snap->sortedPrefix) return;
+    if (snap->sortedPrefix > 0 && upto < 2 * snap->sortedPrefix)
+        upto = 2 * snap->sortedPrefix;
+    if (upto * 2 > snap->count) upto = snap->count;    // cheaper to finish the sort
+    if (upto <= snap->sortedPrefix) return;
+
+    SnapEntry **tail = snap->order + snap->sortedPrefix;
+    size_t tailLen = snap->count - snap->sortedPrefix;
+    size_t want = upto - snap->sortedPrefix;
+
+    if (want < tailLen)
+        selectSmallest(tail, tailLen, want, snap->compare);
+
+    activeCompare = snap->compare;
+    qsort(tail, want, sizeof(SnapEntry *), compareEntryPtr);
+    snap->sortedPrefix = upto;
+}
+
+static void copyPage(DirSnapshot *snap, size_t from, size_t n, FileInfo page[]) {
+    for (size_t i = 0; i < n; i++) {
+        SnapEntry *e = snap->order[from + i];
+
+        if (!e->resolved) {
+            struct passwd *pw = metGetpwuid(e->uid);
+            struct group  *gr = metGetgrgid(e->gid);
+            snprintf(e->info.owner, sizeof(e->info.owner), "%s", pw ? pw->pw_name : "unknown");
+            snprintf(e->info.group, sizeof(e->info.group), "%s", gr ? gr->gr_name : "unknown");
+            e->resolved = 1;
+        }
+        page[i] = e->info;
+    }
+}
+
+DirSnapshot *openDirSnapshot(const char *path, int sortChoice) {
+    DirListing dl;
+
+    if (readDirListing(path, traversalPolicy.followSymlinks, &dl) != 0) {
         perror("Unable to open directory");
-        return;
+        return NULL;
+    }
+
+    DirSnapshot *snap = calloc(1, sizeof(DirSnapshot));
+    if (!snap) {
+        freeDirListing(&dl);
+        return NULL;
+    }
+
+    switch (sortChoice) {
+        case 2:  snap->compare = cursorBySize; break;
+        case 3:  snap->compare = cursorByDate; break;
+        default: snap->compare = cursorByName; break;
     }
 
     // -------------------------------------------------
-    // Read all directory entries
+    // Keep every regular file (no fixed upper bound)
     // -------------------------------------------------
-    while ((de = readdir(dr)) != NULL) {
+    snap->capacity = dl.count ? (size_t)dl.count : 1;
+    snap->entries = malloc(snap->capacity * sizeof(SnapEntry));
+    snap->order = malloc(snap->capacity * sizeof(SnapEntry *));
+    if (!snap->entries || !snap->order) {
+        fprintf(stderr, "Memory allocation failed for directory snapshot\n");
+        freeDirListing(&dl);
+        closeDirSnapshot(snap);
+        return NULL;
+    }
 
-        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+    for (int i = 0; i < dl.count; i++) {
+        struct stat *st = &dl.st[i];
+
+        if (dl.err[i] != 0 || !S_ISREG(st->st_mode))
             continue;
 
-        snprintf(fullPath, sizeof(fullPath), "%s/%s", path, de->d_name);
+        SnapEntry *e = &snap->entries[snap->count];
+        memset(e, 0, sizeof(*e));
+        snprintf(e->info.name, sizeof(e->info.name), "%s", dl.names[i]);
+        e->info.size = st->st_size;
+        e->info.allocated = (off_t)st->st_blocks * 512;
+        e->info.modified = st->st_mtime;
+        e->uid = st->st_uid;
+        e->gid = st->st_gid;
 
-        if (stat(fullPath, &st) == 0 && S_ISREG(st.st_mode)) {
+        snap->order[snap->count] = e;
+        snap->count++;
+    }
 
-            strcpy(files[count].name, de->d_name);
-            files[count].size = st.st_size;
+    freeDirListing(&dl);
+    return snap;
+}
 
-            struct passwd *pw = getpwuid(st.st_uid);
-            struct group  *gr = getgrgid(st.st_gid);
+void closeDirSnapshot(DirSnapshot *snap) {
+    if (!snap) return;
+    free(snap->order);
+    free(snap->entries);
+    free(snap);
+}
 
-            strcpy(files[count].owner, pw ? pw->pw_name : "unknown");
-            strcpy(files[count].group, gr ? gr->gr_name : "unknown");
-            files[count].modified = st.st_mtime;
+size_t dirSnapshotCount(const DirSnapshot *snap) {
+    return snap ? snap->count : 0;
+}
 
-            count++;
-        }
-    }
+size_t fetchDirPage(DirSnapshot *snap, size_t offset, size_t limit, FileInfo page[]) {
+    if (!snap || offset >= snap->count || limit == 0) return 0;
 
-    closedir(dr);
+    size_t n = snap->count - offset;
+    if (n > limit) n = limit;
 
-    // -------------------------------------------------
-    // Sorting based on user choice
-    // -------------------------------------------------
-    switch (sortChoice) {
-        case 1:
-            qsort(files, count, sizeof(FileInfo), compareByName);
-            break;
+    extendSortedPrefix(snap, offset + n);
+    copyPage(snap, offset, n, page);
+    return n;
+}
 
-        case 2:
-            qsort(files, count, sizeof(FileInfo), compareBySize);
-            break;
+size_t fetchDirPageAfter(DirSnapshot *snap, const FileInfo *after, size_t limit, FileInfo page[]) {
+    if (!snap) return 0;
+    if (!after) return fetchDirPage(snap, 0, limit, page);
 
-        case 3:
-            qsort(files, count, sizeof(FileInfo), compareByDate);
-            break;
+    // Grow the sorted prefix until it contains something past 'after'
+    size_t step = limit ? limit : 1;
+    while (snap->sortedPrefix < snap->count &&
+           (snap->sortedPrefix == 0 ||
+            snap->compare(&snap->order[snap->sortedPrefix - 1]->info, after) <= 0)) {
+        extendSortedPrefix(snap, snap->sortedPrefix + step);
+        step *= 2;
+    }
 
-        default:
-            qsort(files, count, sizeof(FileInfo), compareByName);
-            break;
+    // Binary search for the first entry strictly greater than 'after'
+    size_t lo = 0, hi = snap->sortedPrefix;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (snap->compare(&snap->order[mid]->info, after) <= 0) lo = mid + 1;
+        else hi = mid;
     }
 
-    // -------------------------------------------------
-    // Print Sorted Output
-    // Thread-Safe Printing
-    // -------------------------------------------------
+    return fetchDirPage(snap, lo, limit, page);
+}
 
-    printf("\nListing of Directory: %s\n", path);
+// -----------------------------------------------------
+// Main Directory Listing + Sorting Function
+// -----------------------------------------------------
+
+void listAndSortDirectory(const char *path, int sortChoice) {
+    DirSnapshot *snap = openDirSnapshot(path, sortChoice);
+    if (!snap) return;
+
+    FileInfo *page = malloc(sizeof(FileInfo) * LISTING_PAGE_SIZE);
+    if (!page) {
+        fprintf(stderr, "Memory allocation failed for listing page\n");
+        closeDirSnapshot(snap);
+        return;
+    }
+
+    printf("\nListing of Directory: %s (%zu files)\n", path, dirSnapshotCount(snap));
     printf("-----------------------------------------------------------------------------------------------------\n");
     printf("%-25s %-12s %-12s %-12s %-25s\n", "File Name", "Size(B)", "Owner", "Group", "Last Modified");
     printf("-----------------------------------------------------------------------------------------------------\n");
 
-    for (int i = 0; i < count; i++) {
+    // -------------------------------------------------
+    // Print page by page from the snapshot
+    // Thread-Safe Printing (one lock per page)
+    // -------------------------------------------------
+    size_t offset = 0, n;
+    while ((n = fetchDirPage(snap, offset, LISTING_PAGE_SIZE, page)) > 0) {
 
-        lockFileOps();  // Thread-safe printing
+        lockFileOps();
+        METRIC_START(t);
 
-        printf("%-25s %-12ld %-12s %-12s %-25s",
-               files[i].name,
-               (long)files[i].size,
-               files[i].owner,
-               files[i].group,
-               ctime(&files[i].modified));
+        for (size_t i = 0; i < n; i++) {
+            printf("%-25s %-12ld %-12s %-12s %-25s",
+                   page[i].name,
+                   (long)page[i].size,
+                   page[i].owner,
+                   page[i].group,
+                   ctime(&page[i].modified));
+        }
 
+        METRIC_STOP(MET_FORMAT, t);
         unlockFileOps();
+        offset += n;
     }
 
     printf("-----------------------------------------------------------------------------------------------------\n");
+
+    free(page);
+    closeDirSnapshot(snap);
 }
@@ -17,7 +17,9 @@ void destroySyncMechanisms() {
 
 // Helper functions
 void lockFileOps() {
+    METRIC_START(t);
     pthread_mutex_lock(&fileLock);
+    METRIC_STOP(MET_LOCK_WAIT, t);
 }
 
 void unlockFileOps() {
@@ -0,0 +1,169 @@
+// throttle.c
+// I/O throttling for maintenance jobs (SRU cleanup, recursive delete,
+// copy/move): token-bucket limits on file operations and bytes per
+// second, idle I/O priority, and adaptive backoff when the observed
+// syscall latency climbs above its usual level.
+#include "dir_manage.h"
+#include <errno.h>
+#include <sys/syscall.h>
+
+ThrottleConfig throttleConfig = { 0 };
+
+// Set once limits or backoff are configured; lets the hot path return early
+static int throttleActive = 0;
+
+// linux/ioprio.h is not shipped everywhere; the ABI values are stable
+#define IOPRIO_CLASS_SHIFT  13
+#define IOPRIO_CLASS_IDLE   3
+#define IOPRIO_WHO_PROCESS  1
+
+#define BACKOFF_MIN_NS      1000000ULL      // 1 ms
+#define BACKOFF_MAX_NS      200000000ULL    // 200 ms
+#define LATENCY_SPIKE       2               // fast avg > 2x baseline => back off
+
+typedef struct TokenBucket {
+    double rate;        // tokens per second (0 = unlimited)
+    double capacity;    // burst size
+    double tokens;      // may go negative (debt) for oversized requests
+    unsigned long long lastNs;
+} TokenBucket;
+
+static pthread_mutex_t throttleLock = PTHREAD_MUTEX_INITIALIZER;
+static TokenBucket opsBucket, bytesBucket;
+
+// Latency tracking (EWMA, nanoseconds) for adaptive backoff
+static double baselineNs = 0, recentNs = 0;
+static unsigned long long backoffNs = 0;
+
+// ===============================================================
+// TOKEN BUCKETS
+// ===============================================================
+static void bucketInit(TokenBucket *b, double rate, double minBurst) {
+    memset(b, 0, sizeof(*b));
+    b->rate = rate;
+    b->capacity = rate > minBurst ? rate : minBurst;   // ~1 second of burst
+    b->tokens = b->capacity;
+    b->lastNs = metricsNow();
+}
+
+// Take n tokens; returns how long the caller must sleep (ns)
+static unsigned long long bucketTake(TokenBucket *b, double n, unsigned long long now) {
+    if (b->rate <= 0 || n <= 0) return 0;
+
+    b->tokens += (now - b->lastNs) / 1e9 * b->rate;
+    if (b->tokens > b->capacity) b->tokens = b->capacity;
+    b->lastNs = now;
+
+    b->tokens -= n;
+    if (b->tokens >= 0) return 0;
+    return (unsigned long long)(-b->tokens / b->rate * 1e9);
+}
+
+static void sleepNs(unsigned long long ns) {
+    struct timespec ts = { (time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL) };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+        ;
+}
+
+// ===============================================================
+// PUBLIC API
+// ===============================================================
+
+// Apply the current throttleConfig. Call after parsing options and
+// before starting worker threads (they inherit the I/O priority).
+int applyThrottleConfig(void) {
+    int rc = 0;
+
+    pthread_mutex_lock(&throttleLock);
+    bucketInit(&opsBucket, throttleConfig.opsPerSec, 1);
+    bucketInit(&bytesBucket, throttleConfig.bytesPerSec, 65536);
+    baselineNs = recentNs = 0;
+    backoffNs = 0;
+    throttleActive = throttleConfig.opsPerSec > 0 || throttleConfig.bytesPerSec > 0 ||
+                     throttleConfig.adaptive;
+    pthread_mutex_unlock(&throttleLock);
+
+    if (throttleConfig.idleIoPriority) {
+        int prio = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+        if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, prio) != 0) {
+            perror("ioprio_set(idle)");
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+// Block until 'ops' file operations and 'bytes' of data may proceed.
+void throttleAcquire(unsigned ops, unsigned long long bytes) {
+    if (!throttleActive) return;
+
+    pthread_mutex_lock(&throttleLock);
+    unsigned long long now = metricsNow();
+    unsigned long long waitOps = bucketTake(&opsBucket, ops, now);
+    unsigned long long waitBytes = bucketTake(&bytesBucket, (double)bytes, now);
+    unsigned long long wait = waitOps > waitBytes ? waitOps : waitBytes;
+    if (ops || bytes) wait += backoffNs;
+    pthread_mutex_unlock(&throttleLock);
+
+    if (wait > 0) {
+        METRIC_START(t);
+        sleepNs(wait);
+        METRIC_STOP(MET_THROTTLE_WAIT, t);
+    }
+}
+
+// Timestamp for measuring the latency passed to throttleObserve(). 0, and
+// no clock read, unless adaptive throttling is on.
+unsigned long long throttleNow(void) {
+    return (throttleActive && throttleConfig.adaptive) ? metricsNow() : 0;
+}
+
+// Feed back the latency of one throttled I/O. A fast moving average well
+// above the slow baseline doubles the backoff delay; recovery halves it.
+void throttleObserve(unsigned long long latencyNs) {
+    if (!throttleActive || !throttleConfig.adaptive) return;
+
+    pthread_mutex_lock(&throttleLock);
+    if (baselineNs == 0) {
+        baselineNs = recentNs = (double)latencyNs;
+    } else {
+        recentNs += ((double)latencyNs - recentNs) / 8;
+
+        if (recentNs > LATENCY_SPIKE * baselineNs) {
+            backoffNs = backoffNs ? backoffNs * 2 : BACKOFF_MIN_NS;
+            if (backoffNs > BACKOFF_MAX_NS) backoffNs = BACKOFF_MAX_NS;
+        } else {
+            // Only healthy samples move the baseline, so a sustained
+            // slowdown cannot become the new normal
+            baselineNs += ((double)latencyNs - baselineNs) / 64;
+            backoffNs /= 2;
+            if (backoffNs < BACKOFF_MIN_NS / 2) backoffNs = 0;
+        }
+    }
+    pthread_mutex_unlock(&throttleLock);
+}
+
+// Parse one throttling flag. Returns the number of arguments consumed.
+//   --max-ops N     file operations per second
+//   --max-mbps N    data MB per second
+//   --idle-io       idle I/O priority class
+//   --adaptive      back off when syscall latency rises
+int parseThrottleFlag(int argc, char *argv[]) {
+    if (strcmp(argv[0], "--max-ops") == 0 && argc > 1) {
+        throttleConfig.opsPerSec = atof(argv[1]);
+        return 2;
+    }
+    if (strcmp(argv[0], "--max-mbps") == 0 && argc > 1) {
+        throttleConfig.bytesPerSec = atof(argv[1]) * 1024 * 1024;
+        return 2;
+    }
+    if (strcmp(argv[0], "--idle-io") == 0) {
+        throttleConfig.idleIoPriority = 1;
+        return 1;
+    }
+    if (strcmp(argv[0], "--adaptive") == 0) {
+        throttleConfig.adaptive = 1;
+        return 1;
+    }
+    return 0;
+}
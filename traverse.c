@@ -0,0 +1,338 @@
+// traverse.c
+// Traversal policy (symlinks, one-filesystem) and the visited-inode set
+// shared by the recursive walkers.
+#include "dir_manage.h"
+#include <errno.h>
+
+// Default keeps the historical behaviour: symlinks are followed (stat),
+// mount points are crossed. Cycles are cut by the visited-directory set.
+TraversalPolicy traversalPolicy = { .followSymlinks = 1, .oneFilesystem = 0 };
+
+// ===============================================================
+// VISITED (dev, inode) SET
+// ===============================================================
+// Sharded open-addressing hash set. Each shard has its own lock and
+// grows independently, so concurrent walkers rarely contend and no
+// global rehash ever stops the world. 16 bytes per entry.
+#define INODE_SET_SHARDS     64
+#define INODE_SHARD_INITIAL  256
+
+typedef struct InodeKey {
+    unsigned long long dev;
+    unsigned long long ino;     // 0 = empty slot (inode 0 is never used)
+} InodeKey;
+
+typedef struct InodeShard {
+    pthread_mutex_t lock;
+    InodeKey *slots;
+    size_t capacity;            // power of two
+    size_t used;
+} InodeShard;
+
+struct InodeSet {
+    InodeShard shards[INODE_SET_SHARDS];
+};
+
+static unsigned long long hashKey(unsigned long long dev, unsigned long long ino) {
+    // splitmix64 finaliser over both halves
+    unsigned long long h = ino ^ (dev * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 30; h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27; h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h;
+}
+
+InodeSet *createInodeSet(void) {
+    InodeSet *set = calloc(1, sizeof(InodeSet));
+    if (!set) return NULL;
+    for (int i = 0; i < INODE_SET_SHARDS; i++)
+        pthread_mutex_init(&set->shards[i].lock, NULL);
+    return set;
+}
+
+void destroyInodeSet(InodeSet *set) {
+    if (!set) return;
+    for (int i = 0; i < INODE_SET_SHARDS; i++) {
+        pthread_mutex_destroy(&set->shards[i].lock);
+        free(set->shards[i].slots);
+    }
+    free(set);
+}
+
+static int shardGrow(InodeShard *sh) {
+    size_t newCap = sh->capacity ? sh->capacity * 2 : INODE_SHARD_INITIAL;
+    InodeKey *slots = calloc(newCap, sizeof(InodeKey));
+    if (!slots) return -1;
+
+    for (size_t i = 0; i < sh->capacity; i++) {
+        InodeKey k = sh->slots[i];
+        if (k.ino == 0) continue;
+        size_t pos = hashKey(k.dev, k.ino) & (newCap - 1);
+        while (slots[pos].ino != 0) pos = (pos + 1) & (newCap - 1);
+        slots[pos] = k;
+    }
+
+    free(sh->slots);
+    sh->slots = slots;
+    sh->capacity = newCap;
+    return 0;
+}
+
+// Returns 1 if (dev, ino) was not in the set and has been added,
+// 0 if it was already present, -1 on allocation failure.
+int inodeSetInsert(InodeSet *set, dev_t dev, ino_t ino) {
+    unsigned long long h = hashKey((unsigned long long)dev, (unsigned long long)ino);
+    InodeShard *sh = &set->shards[h >> 58];    // top 6 bits pick the shard
+    int rc = 1;
+
+    if (ino == 0) return 1;     // cannot be represented; never deduplicate
+
+    pthread_mutex_lock(&sh->lock);
+
+    // Keep load factor under 70%
+    if ((sh->used + 1) * 10 > sh->capacity * 7 && shardGrow(sh) != 0) {
+        pthread_mutex_unlock(&sh->lock);
+        return -1;
+    }
+
+    size_t pos = h & (sh->capacity - 1);
+    while (sh->slots[pos].ino != 0) {
+        if (sh->slots[pos].ino == (unsigned long long)ino &&
+            sh->slots[pos].dev == (unsigned long long)dev) {
+            rc = 0;
+            break;
+        }
+        pos = (pos + 1) & (sh->capacity - 1);
+    }
+    if (rc == 1) {
+        sh->slots[pos].dev = (unsigned long long)dev;
+        sh->slots[pos].ino = (unsigned long long)ino;
+        sh->used++;
+    }
+
+    pthread_mutex_unlock(&sh->lock);
+    return rc;
+}
+
+int inodeSetContains(InodeSet *set, dev_t dev, ino_t ino) {
+    unsigned long long h = hashKey((unsigned long long)dev, (unsigned long long)ino);
+    InodeShard *sh = &set->shards[h >> 58];
+    int found = 0;
+
+    if (ino == 0) return 0;
+
+    pthread_mutex_lock(&sh->lock);
+    for (size_t pos = h & (sh->capacity - 1); sh->capacity && sh->slots[pos].ino != 0;
+         pos = (pos + 1) & (sh->capacity - 1)) {
+        if (sh->slots[pos].ino == (unsigned long long)ino &&
+            sh->slots[pos].dev == (unsigned long long)dev) {
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return found;
+}
+
+// ===============================================================
+// POLICY HELPERS
+// ===============================================================
+
+// stat() or lstat() depending on the symlink policy. *wasLink is set
+// when the entry itself is a symlink (and was followed).
+int statForTraversal(const char *path, struct stat *st, int *wasLink) {
+    if (wasLink) *wasLink = 0;
+
+    if (!traversalPolicy.followSymlinks)
+        return metLstat(path, st);
+
+    if (metLstat(path, st) != 0) return -1;
+    if (!S_ISLNK(st->st_mode)) return 0;
+
+    if (wasLink) *wasLink = 1;
+    return metStat(path, st);
+}
+
+int traversalStart(TraversalState *ts, const char *root) {
+    struct stat st;
+
+    memset(ts, 0, sizeof(*ts));
+    if (metStat(root, &st) != 0) return -1;
+
+    ts->rootDev = st.st_dev;
+    ts->visited = createInodeSet();
+    ts->linkedDirs = createInodeSet();
+    ts->primaries = createInodeSet();
+    if (!ts->visited || !ts->linkedDirs || !ts->primaries) {
+        traversalEnd(ts);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    inodeSetInsert(ts->visited, st.st_dev, st.st_ino);
+    return 0;
+}
+
+void traversalEnd(TraversalState *ts) {
+    destroyInodeSet(ts->visited);
+    destroyInodeSet(ts->linkedDirs);
+    destroyInodeSet(ts->primaries);
+    ts->visited = ts->linkedDirs = ts->primaries = NULL;
+}
+
+// Should the walker descend into this directory? Enforces -xdev and
+// refuses directories already visited (symlink or bind-mount cycles).
+// viaLink: the directory, or one above it, was reached through a
+// symlink. Such a walk is kept apart so that it cannot claim the real
+// directory: the real path is still walked when it comes up later, and
+// a linked walk is skipped when the real one already happened.
+int traversalEnterDir(TraversalState *ts, const struct stat *st, int viaLink) {
+    if (traversalPolicy.oneFilesystem && st->st_dev != ts->rootDev)
+        return 0;
+    if (!viaLink)
+        return inodeSetInsert(ts->visited, st->st_dev, st->st_ino) != 0;
+    if (inodeSetContains(ts->visited, st->st_dev, st->st_ino))
+        return 0;
+    return inodeSetInsert(ts->linkedDirs, st->st_dev, st->st_ino) != 0;
+}
+
+// Is this the first time this file's data is seen, through any path?
+// Totals count only first visits. When symlinks are followed any file
+// may be seen again through a link, so every file is recorded; with -P
+// only hardlinks can repeat.
+int traversalFirstVisit(TraversalState *ts, const struct stat *st, int viaLink) {
+    if (!viaLink && st->st_nlink <= 1 && !traversalPolicy.followSymlinks)
+        return 1;
+    return inodeSetInsert(ts->visited, st->st_dev, st->st_ino) != 0;
+}
+
+// Is this the first real (symlink-free) path to the file? Only that
+// path may be deleted or packed: removing a link frees nothing, and
+// a second hardlink holds the same data. Independent of the order in
+// which links and real paths come up.
+int traversalPrimaryPath(TraversalState *ts, const struct stat *st, int viaLink) {
+    if (viaLink)
+        return 0;
+    if (st->st_nlink <= 1)
+        return 1;
+    return inodeSetInsert(ts->primaries, st->st_dev, st->st_ino) != 0;
+}
+
+// Parse one policy flag (-L/--follow, -P/--no-follow, --xdev).
+// Returns 1 if the flag was consumed.
+int parseTraversalFlag(const char *arg) {
+    if (strcmp(arg, "-L") == 0 || strcmp(arg, "--follow") == 0) {
+        traversalPolicy.followSymlinks = 1;
+    } else if (strcmp(arg, "-P") == 0 || strcmp(arg, "--no-follow") == 0) {
+        traversalPolicy.followSymlinks = 0;
+    } else if (strcmp(arg, "--xdev") == 0) {
+        traversalPolicy.oneFilesystem = 1;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// ===============================================================
+// WHOLE-DIRECTORY LISTING
+// ===============================================================
+// Reading all names first and then stat-ing them as one batch lets the
+// I/O backend keep many metadata requests in flight (io_uring), and
+// the fallback uses fstatat() relative to the directory instead of
+// re-resolving the full path for every entry.
+int readDirListing(const char *path, int followSymlinks, DirListing *dl) {
+    struct dirent *de;
+    size_t arenaLen = 0, arenaCap = 0, *offsets = NULL;
+    unsigned char *types = NULL;
+    int cap = 0;
+
+    memset(dl, 0, sizeof(*dl));
+    dl->dirFd = -1;
+
+    DIR *dr = metOpendir(path);
+    if (!dr) return -1;
+
+    while ((de = metReaddir(dr)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+
+        size_t len = strlen(de->d_name) + 1;
+        if (arenaLen + len > arenaCap) {
+            size_t newCap = arenaCap ? arenaCap * 2 : 4096;
+            while (newCap < arenaLen + len) newCap *= 2;
+            char *grown = realloc(dl->arena, newCap);
+            if (!grown) goto fail;
+            dl->arena = grown;
+            arenaCap = newCap;
+        }
+        if (dl->count == cap) {
+            int newCap = cap ? cap * 2 : 64;
+            size_t *grown = realloc(offsets, sizeof(size_t) * newCap);
+            if (!grown) goto fail;
+            offsets = grown;
+            unsigned char *grownTypes = realloc(types, newCap);
+            if (!grownTypes) goto fail;
+            types = grownTypes;
+            cap = newCap;
+        }
+
+        memcpy(dl->arena + arenaLen, de->d_name, len);
+        types[dl->count] = de->d_type;
+        offsets[dl->count++] = arenaLen;
+        arenaLen += len;
+    }
+
+    dl->dirFd = dup(dirfd(dr));
+    closedir(dr);
+    dr = NULL;
+    if (dl->dirFd < 0) goto fail;
+
+    int n = dl->count ? dl->count : 1;
+    dl->names = malloc(sizeof(char *) * n);
+    dl->st = malloc(sizeof(struct stat) * n);
+    dl->err = malloc(sizeof(int) * n);
+    dl->isLink = malloc(n);
+    if (!dl->names || !dl->st || !dl->err || !dl->isLink) goto fail;
+
+    for (int i = 0; i < dl->count; i++)
+        dl->names[i] = dl->arena + offsets[i];
+    free(offsets);
+    offsets = NULL;
+
+    ioStatBatch(dl->dirFd, (const char *const *)dl->names, dl->count,
+                followSymlinks ? 0 : AT_SYMLINK_NOFOLLOW, dl->st, dl->err);
+
+    // d_type says whether a name is a symlink; only file systems that
+    // leave it unset need an extra lstat
+    for (int i = 0; i < dl->count; i++) {
+        struct stat lst;
+        if (!followSymlinks)
+            dl->isLink[i] = S_ISLNK(dl->st[i].st_mode);
+        else if (types[i] != DT_UNKNOWN)
+            dl->isLink[i] = types[i] == DT_LNK;
+        else
+            dl->isLink[i] = fstatat(dl->dirFd, dl->names[i], &lst, AT_SYMLINK_NOFOLLOW) == 0 &&
+                            S_ISLNK(lst.st_mode);
+    }
+    free(types);
+    return 0;
+
+fail:
+    if (dr) closedir(dr);
+    free(offsets);
+    free(types);
+    freeDirListing(dl);
+    errno = ENOMEM;
+    return -1;
+}
+
+void freeDirListing(DirListing *dl) {
+    if (dl->dirFd >= 0) close(dl->dirFd);
+    free(dl->names);
+    free(dl->st);
+    free(dl->err);
+    free(dl->isLink);
+    free(dl->arena);
+    memset(dl, 0, sizeof(*dl));
+    dl->dirFd = -1;
+}